@@ -0,0 +1,250 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/****************************************************************************************************
+* FILE NAME: ocv_fit.c                                                                              *
+*                                                                                                   *
+* PURPOSE: Fits the cell model tables with the OCV_CHEB representation of OCV_MODEL.c, as           *
+*           pxOCVModelCreate does at model load, and reports the maximum error of OCV and           *
+*           dOCV against the original tables, at every model temperature.                           *
+*           Usage: ./ocv_fit [path of the csv files, default ../csv/]                               *
+*           Segments and degree: make clean && make SEGS=8 DEG=7                                    *
+*                                                                                                   *
+* FILE REFERENCES:                                                                                  *
+*                                                                                                   *
+*   Name                    I/O     Description                                                     *
+*   ----                    ---     -----------                                                     *
+*   CellModel*.csv          I       Cell model tables, as read by main.c                            *
+*   CellModeltemps.csv      I       Temperatures of the cell model                                  *
+*                                                                                                   *
+* EXTERNAL REFERENCES:                                                                              *
+*                                                                                                   *
+*  Name                       Description                                                           *
+*  -------------              -----------                                                           *
+*  pxOCVModelCreate           Fit of the tables, from OCV_MODEL.c                                   *
+*  fOCVfromSOC                OCV of the fit, from OCV_MODEL.c                                      *
+*  fDOCVfromSOC               dOCV of the fit, from OCV_MODEL.c                                     *
+*                                                                                                   *
+* ABNORMAL TERMINATION CONDITIONS, ERROR AND WARNING MESSAGES:                                      *
+*    returns 1 if a file cannot be read or the fit fails                                            *
+*                                                                                                   *
+* DEVELOPMENT HISTORY:                                                                              *
+*                                                                                                   *
+*   Date          Author            Change Id     Release     Description Of Change                 *
+*   ----          ------            ---------     ------      ----------------------                *
+*   17-10-2026    agent                            1          Project created                       *
+*                                                                                                   *
+****************************************************************************************************/
+
+#include "../include/OCV_MODEL.h"
+
+#if OCV_MODEL_KIND != OCV_CHEB
+#error "ocv_fit is built with OCV_MODEL_KIND = OCV_CHEB, see Tools/Makefile"
+#endif
+
+/* Maximum number of model temperatures */
+#define MAX_TEMPS   32
+
+/* Files of the rows of OvS, as main.c */
+static const char* files[OvSLenght] =
+{
+    "CellModelOCV.csv",  "CellModelOCV0.csv", "CellModelOCVrel.csv", "CellModelSOC.csv",
+    "CellModelSOC0.csv", "CellModelSOCrel.csv", "CellModeldOCV0.csv", "CellModeldOCVrel.csv"
+};
+
+static int iReadCSV(const char*, const char*, float*, int);
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iReadCSV                                                       *
+*                                                                               *
+* PURPOSE: Reads the comma separated values of a file, at most max              *
+*           of them, or counts them if v is NULL                                *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* dir       const char*   I      Path of the files                              *
+* name      const char*   I      Name of the file                               *
+* v         float*        O      Values, or NULL                                *
+* max       int           I      Maximum number of values                       *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*               number of values, -1 if the file cannot be opened               *
+*                                                                               *
+********************************************************************************/
+
+static int iReadCSV(const char* dir, const char* name, float* v, int max)
+{
+    char  path[512];
+    FILE* f;
+    float x;
+    int   n = 0;
+
+    snprintf(path, sizeof(path), "%s%s", dir, name);
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while ((v == NULL || n < max) && fscanf(f, "%f", &x) == 1)
+    {
+        if (v != NULL)
+            v[n] = x;
+        n++;
+        if (fscanf(f, ",") < 0)
+            break;
+    }
+
+    fclose(f);
+    return n;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: main                                                           *
+*                                                                               *
+* PURPOSE: Reads the tables, fits them and prints the maximum errors            *
+*           on the points of the tables and three points in each bin            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* argc      int          I      counter of inputs                               *
+* argv      char*        I      Path of the files                               *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*                                                                               *
+********************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       ---------------
+     * dir           const char*   Path of the files
+     * OvS           Matrix*       Cell model tables
+     * o             OCVModel*     Fit of the tables
+     * temps         float[]       Model temperatures
+     * nt            int           Number of temperatures
+     * n             int           Points of the SOC row
+     * e, ed         float         Maximum errors of OCV and dOCV
+     * se, te        float         SOC and T of e
+     * sd, td        float         SOC and T of ed
+     * es, eds       float[]       Maximum errors in each segment
+     */
+
+    const char* dir = (argc > 1) ? argv[1] : "../csv/";
+    Matrix*     OvS;
+    OCVModel*   o;
+    float       temps[MAX_TEMPS];
+    int         nt;
+    int         n;
+    float       e  = 0, se = 0, te = 0;
+    float       ed = 0, sd = 0, td = 0;
+    float       es[OCV_CHEB_SEGS]  = { 0 };
+    float       eds[OCV_CHEB_SEGS] = { 0 };
+
+    n = iReadCSV(dir, files[OCV], NULL, 0);
+    if (n < 2)
+        return 1;
+
+    OvS = pxCreate(OvSLenght, n);
+    for (int i = 0; i < OvSLenght; i++)
+    {
+        if (iReadCSV(dir, files[i], OvS->matrix[i], n) < 0)
+            return 1;
+    }
+
+    nt = iReadCSV(dir, "CellModeltemps.csv", temps, MAX_TEMPS);
+    if (nt < 1)
+        return 1;
+
+    o = pxOCVModelCreate(OvS);
+    if (o == NULL)
+    {
+        fprintf(stderr, "fit failed\n");
+        return 1;
+    }
+
+    /* Points of the SOC row, zero padded after the last one */
+    const float* s = OvS->matrix[SOC];
+    n = 1;
+    while (n < (int)OvS->c && s[n] > s[n - 1])
+        n++;
+
+    for (int t = 0; t < nt; t++)
+    {
+        const float T = temps[t];
+
+        for (int j = 0; j < n - 1; j++)
+        {
+            for (int q = 0; q < 4; q++)
+            {
+                const float a    = q / 4.0f;
+                const float soc  = s[j] + a * (s[j + 1] - s[j]);
+                const float ocv  = (1 - a) * (OvS->matrix[OCV0][j] + T * OvS->matrix[OCVrel][j])
+                                 + a * (OvS->matrix[OCV0][j + 1] + T * OvS->matrix[OCVrel][j + 1]);
+                const float docv = (1 - a) * (OvS->matrix[dOCV0][j] + T * OvS->matrix[dOCVrel][j])
+                                 + a * (OvS->matrix[dOCV0][j + 1] + T * OvS->matrix[dOCVrel][j + 1]);
+                const float d    = fabsf(fOCVfromSOC(soc, T, o) - ocv);
+                const float dd   = fabsf(fDOCVfromSOC(soc, T, o) - docv);
+                int         g    = (int)((soc - o->seg.x0) * o->seg.h_inv);
+
+                if (g > OCV_CHEB_SEGS - 1)
+                    g = OCV_CHEB_SEGS - 1;
+                es[g]  = fmaxf(es[g], d);
+                eds[g] = fmaxf(eds[g], dd);
+
+                if (d > e)
+                {
+                    e  = d;
+                    se = soc;
+                    te = T;
+                }
+                if (dd > ed)
+                {
+                    ed = dd;
+                    sd = soc;
+                    td = T;
+                }
+            }
+        }
+    }
+
+    printf("OCV_CHEB: %d segments, degree %d, %zu bytes of coefficients\n",
+           OCV_CHEB_SEGS, OCV_CHEB_DEG, (size_t)OCV_CHEB_SEGS * C_SIZE * sizeof(float));
+    printf("max |OCV  - (OCV0  + T*OCVrel) | = %.6f V   at SOC %.3f, T %.1f\n", e, se, te);
+    printf("max |dOCV - (dOCV0 + T*dOCVrel)| = %.6f V/1 at SOC %.3f, T %.1f\n", ed, sd, td);
+    printf("segment  SOC from   max OCV error   max dOCV error\n");
+    for (int g = 0; g < OCV_CHEB_SEGS; g++)
+        printf("%7d  %8.3f   %13.6f   %14.6f\n", g, o->seg.x0 + g * o->seg.h, es[g], eds[g]);
+
+    vOCVModelDelete(o);
+    vDestroy(OvS);
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/***************************************************************************************************
+*   FILENAME:  OCV_MODEL.h                                                                         *
+*                                                                                                  *
+*                                                                                                  *
+*   PURPOSE:   Library that defines the object OCVModel and all its functions.                     *
+*              An OCVModel holds the OCV(SOC), dOCV(SOC) and SOC(OCV) tables of the cell           *
+*              model (OvS) resampled, once, on uniform grids, so that the bin of a point           *
+*              is computed and not searched: every lookup costs a few FLOPs, no branches.          *
+*              OCV and dOCV are baked on a 2-D (T, SOC) surface, every patch of which              *
+*              holds its bilinear coefficients, so that a lookup reads one patch only.             *
+*              With OCV_MODEL_KIND = OCV_CHEB, OCV is instead a piecewise Chebyshev fit            *
+*              of the tables, evaluated by Horner's scheme, and dOCV its derivative                *
+*                                                                                                  *
+*                                                                                                  *
+*   GLOBAL VARIABLES:                                                                              *
+*                                                                                                  *
+*                                                                                                  *
+*   Variable        Type          Description                                                      *
+*   --------        ----          -------------------                                              *
+*   o               OCVModel      OCVModel object                                                  *
+*                                                                                                  *
+*   DEVELOPMENT HISTORY :                                                                          *
+*                                                                                                  *
+*                                                                                                  *
+*   Date          Author            Change Id     Release     Description Of Change                *
+*   ----          ------            -------- -    ------      ----------------------               *
+*   17-10-2026    agent                             1         Project created                      *
+*   17-10-2026    agent                             2         OCV(T, SOC) and dOCV(T, SOC)         *
+*                                                              bilinear surface                    *
+*   17-10-2026    agent                             3         Fused OCV and dOCV evaluator         *
+*   17-10-2026    agent                             4         Piecewise Chebyshev option           *
+*                                                              (OCV_MODEL_KIND)                    *
+*                                                                                                  *
+***************************************************************************************************/
+
+#ifndef OCV_MODEL_h
+#define OCV_MODEL_h
+
+/* Include Global Parameters */
+
+#include "matrix.h"
+
+/* Definition of Macros */
+
+/* Indexes of Cell SOC_OCv relationship */
+#define OCV 		0
+#define OCV0 		1
+#define OCVrel 		2
+#define SOC 		3
+#define SOC0 		4
+#define SOCrel 		5
+#define dOCV0 		6
+#define dOCVrel 	7
+#define OvSLenght 	8
+
+/* Representations of OCV(T, SOC) and dOCV(T, SOC) */
+#define OCV_SURFACE     0           /* Bilinear surface of the tables */
+#define OCV_CHEB        1           /* Piecewise Chebyshev fit of OCV0 and OCVrel, dOCV its derivative */
+
+#ifndef OCV_MODEL_KIND
+#define OCV_MODEL_KIND  OCV_SURFACE
+#endif
+
+/* Segments of the SOC grid and degree of the OCV_CHEB fit, see Tools/ocv_fit for the error */
+#ifndef OCV_CHEB_SEGS
+#define OCV_CHEB_SEGS   8
+#endif
+#ifndef OCV_CHEB_DEG
+#define OCV_CHEB_DEG    7
+#endif
+
+/* Chebyshev nodes of the fit in each segment */
+#define OCV_CHEB_NODES  (8 * (OCV_CHEB_DEG + 1))
+
+/* Maximum points of a resampled grid */
+#ifndef OCV_MAX_POINTS
+#define OCV_MAX_POINTS  4096
+#endif
+
+/* Temperature grid of the OCV surface, in degrees: the model temperatures by default */
+#ifndef OCV_T_MIN
+#define OCV_T_MIN   -25.0f
+#endif
+#ifndef OCV_T_MAX
+#define OCV_T_MAX   45.0f
+#endif
+#ifndef OCV_T_STEP
+#define OCV_T_STEP  10.0f
+#endif
+
+/*
+ * Rows of OCVModel.tab: SOC0 and SOCrel at the points of the OCV grid,
+ * then the slopes of both in each bin, already divided by the step
+ */
+#define O_SOC0      0           /* SOC0 on the OCV grid */
+#define O_SOCREL    1           /* SOCrel on the OCV grid */
+#define O_SSOC0     2           /* Slope of SOC0 */
+#define O_SSOCREL   3           /* Slope of SOCrel */
+#define O_ROWS      4
+
+/*
+ * Coefficients of a patch of OCVModel.surf, the bin [T_t, T_t+1] x [SOC_j, SOC_j+1]:
+ * f(T, SOC) = f + u*f_s + w*f_t + u*w*f_st, with u = SOC - SOC_j and w = T - T_t.
+ * One patch is P_SIZE floats, 32 bytes, aligned
+ */
+#define P_OCV       0           /* OCV at (T_t, SOC_j) */
+#define P_OCV_S     1           /* dOCV/dSOC */
+#define P_OCV_T     2           /* dOCV/dT */
+#define P_OCV_ST    3           /* d2OCV/dSOCdT */
+#define P_DOCV      4           /* dOCV at (T_t, SOC_j) */
+#define P_DOCV_S    5
+#define P_DOCV_T    6
+#define P_DOCV_ST   7
+#define P_SIZE      8
+
+/* Columns of a row of OCVModel.cheb, one row per segment: coefficients of x^0..x^OCV_CHEB_DEG, x in [-1, 1] */
+#define C_OCV0      0
+#define C_OCVREL    (OCV_CHEB_DEG + 1)
+#define C_SIZE      (2 * (OCV_CHEB_DEG + 1))
+
+/* Uniform grid: point j is x0 + j*h, j = 0..n-1 */
+typedef struct OCVGrid
+{
+
+	float   x0;
+	float   h;
+	float   h_inv;
+	int     n;
+
+} OCVGrid;
+
+/* OCV model structure */
+typedef struct OCVModel
+{
+
+	Matrix* tab;						/* O_ROWS x ocv.n */
+	Matrix* surf;						/* temp.n-1 x (soc.n-1)*P_SIZE, patches of OCV and dOCV */
+	Matrix* cheb;						/* OCV_CHEB: OCV_CHEB_SEGS x C_SIZE, instead of surf */
+	OCVGrid soc;						/* Grid of OCV(SOC) and dOCV(SOC) */
+	OCVGrid temp;						/* Grid of OCV(T) and dOCV(T) */
+	OCVGrid seg;						/* OCV_CHEB: segments of the SOC grid */
+	OCVGrid ocv;						/* Grid of SOC(OCV) */
+
+} OCVModel;
+
+
+/* Declare Prototypes */
+
+OCVModel* pxOCVModelCreate	(const Matrix *);
+void      vOCVModelDelete	(OCVModel *);
+float     fOCVfromSOC		(const float, const float, const OCVModel *);
+float     fDOCVfromSOC		(const float, const float, const OCVModel *);
+float     fSOCfromOCV		(const float, const float, const OCVModel *);
+void      vOCVfromSOCBatch	(const OCVModel *, const float *, const float *, float *, size_t);
+void      vDOCVfromSOCBatch	(const OCVModel *, const float *, const float *, float *, size_t);
+void      vOCVdOCVfromSOCBatch(const OCVModel *, const float *, const float *, float *, float *, size_t);
+
+
+#endif /* OCV_MODEL_h */
@@ -0,0 +1,136 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/***************************************************************************************************
+*   FILENAME:  SOC_BATCH.h                                                                         *
+*                                                                                                  *
+*                                                                                                  *
+*   PURPOSE:   Library that defines the object KalmanBatch and all its functions.                  *
+*              A KalmanBatch runs the per-cell EKF (see EKF_PERCELL in SOC_EKF.h) on               *
+*              thousands of cells, stored as structure of arrays so that the                       *
+*              cells are processed SIMD_W at a time (AVX2: 8, SSE: 4, scalar: 1)                   *
+*                                                                                                  *
+*                                                                                                  *
+*   GLOBAL VARIABLES:                                                                              *
+*                                                                                                  *
+*                                                                                                  *
+*   Variable        Type          Description                                                      *
+*   --------        ----          -------------------                                              *
+*   b               KalmanBatch   KalmanBatch object                                               *
+*                                                                                                  *
+*   DEVELOPMENT HISTORY :                                                                          *
+*                                                                                                  *
+*                                                                                                  *
+*   Date          Author            Change Id     Release     Description Of Change                *
+*   ----          ------            -------- -    ------      ----------------------               *
+*   17-10-2026    agent                             1         Project created                      *
+*   17-10-2026    agent                             2         OvS replaced by the OCVModel         *
+*   17-10-2026    agent                             3         dOCV kept from predict to update     *
+*   17-10-2026    agent                             4         Parameters from a ParamCache         *
+*   17-10-2026    agent                             5         Measured step dt in vBatchStep1      *
+*                                                                                                  *
+***************************************************************************************************/
+
+#ifndef SOC_BATCH_h
+#define SOC_BATCH_h
+
+/* Include Global Parameters */
+
+#include "SOC_EKF.h"
+
+/* Definition of Macros */
+
+/* Instruction sets of the batch kernels, see iBatchSetISA */
+#define BATCH_SCALAR    0
+#define BATCH_SSE       1
+#define BATCH_AVX2      2
+
+/* Rows of KalmanBatch.st, one value per cell in each row */
+#define B_XI    0           /*     Current state     */
+#define B_XH    1           /*   Hysteresis state    */
+#define B_XZ    2           /*       SOC state       */
+#define B_P00   3           /*                       */
+#define B_P01   4           /*                       */
+#define B_P02   5           /*  Upper triangle of    */
+#define B_P11   6           /*  the 3x3 covariance   */
+#define B_P12   7           /*                       */
+#define B_P22   8           /*                       */
+#define B_IPREV 9           /* Current at the previous step */
+#define B_ISIGN 10          /* Sign of the last non-negligible current */
+#define B_YP    11          /* Predicted voltage, then residual */
+#define B_Q     12          /* Process noise covariance */
+#define B_R     13          /* Sensor noise covariance */
+#define B_H2    14          /* dOCV at the predicted SOC, from the predict kernel */
+#define B_ROWS  15
+
+/* Rows of KalmanBatch.lut, OCV(SOC) and dOCV(SOC) at the temperature lut_T */
+#define L_OCV   0           /* OCV at the grid points */
+#define L_SOCV  1           /* Slope of OCV in each bin */
+#define L_DOCV  2           /* dOCV at the grid points */
+#define L_SDOCV 3           /* Slope of dOCV in each bin */
+#define L_ROWS  4
+
+struct KalmanBatch;
+
+/* Predict and update kernels, one per instruction set, on cells [from, to) */
+typedef void (*BatchKernel)(struct KalmanBatch*, const float*, size_t, size_t);
+
+/* Kalman batch structure */
+typedef struct KalmanBatch
+{
+
+	size_t  n;							/* Number of cells */
+	Matrix* st;							/* B_ROWS x n, structure of arrays of the cells */
+	Matrix* lut;						/* L_ROWS x n_soc, OCV tables on the uniform SOC grid */
+	const OCVModel* Ocv;				/* Cell model tables, owned by a Kalman */
+	const Matrix* Param;
+
+	ParamCache Par;						/* Parameters at time t, see vParamCacheUpdate */
+	float   dt_carry;					/* Rounding error of the last step, see DT_RES */
+	float   soc0;						/* First point of the SOC grid */
+	float   h;							/* Step of the SOC grid */
+	float   h_inv;						/* 1 / h */
+	int     n_soc;						/* Points of the SOC grid */
+	float   lut_T;						/* Temperature of lut, the center of a bucket (fParamBucket) */
+
+	int         isa;					/* BATCH_SCALAR, BATCH_SSE or BATCH_AVX2 */
+	int         width;					/* Cells per kernel iteration */
+	BatchKernel predict;
+	BatchKernel update;
+	BatchKernel predict_tail;			/* Scalar kernels, for the last n % width cells */
+	BatchKernel update_tail;
+
+} KalmanBatch;
+
+
+/* Declare Prototypes */
+
+int   iBatchSetup	(KalmanBatch *, const Kalman *, size_t, const float, const float *);
+int   iBatchSetISA	(KalmanBatch *, int);
+void  vBatchStep1	(KalmanBatch *, const float *, const float, const float);
+void  vBatchStep2	(KalmanBatch *, const float *, const float);
+float fBatchGetSOC	(const KalmanBatch *, size_t);
+float fBatchGetSOCVar(const KalmanBatch *, size_t);
+void  vBatchDelete	(KalmanBatch *);
+
+
+#endif /* SOC_BATCH_h */
@@ -0,0 +1,332 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/***************************************************************************************************
+*   FILENAME:  SOC_BATCH_kernel.h                                                                  *
+*                                                                                                  *
+*                                                                                                  *
+*   PURPOSE:   Predict and update kernels of the batch engine, written once on GCC vectors of      *
+*              BK_W floats. Only to be included by SOC_BATCH.c, once per instruction set, with:    *
+*                BK_W       lanes of the vectors                                                   *
+*                BK_SUFFIX  suffix of the generated names                                          *
+*                BK_ATTR    function attributes, i.e. the target instruction set                   *
+*              FMA is never enabled, so all the instruction sets give the same results.            *
+*                                                                                                  *
+*   DEVELOPMENT HISTORY :                                                                          *
+*                                                                                                  *
+*                                                                                                  *
+*   Date          Author            Change Id     Release     Description Of Change                *
+*   ----          ------            -------- -    ------      ----------------------               *
+*   17-10-2026    agent                             1         Project created                      *
+*   17-10-2026    agent                             2         OCV and dOCV from one lookup         *
+*   17-10-2026    agent                             3         Constants from the ParamCache        *
+*   17-10-2026    agent                             4         Step dt from the ParamCache          *
+*                                                                                                  *
+***************************************************************************************************/
+
+#if !defined(BK_W) || !defined(BK_SUFFIX) || !defined(BK_ATTR)
+#error "SOC_BATCH_kernel.h is only to be included by SOC_BATCH.c"
+#endif
+
+#define BK_CAT(a, b)    a##b
+#define BK_XCAT(a, b)   BK_CAT(a, b)
+#define BK(name)        BK_XCAT(name, BK_SUFFIX)
+
+#define BK_INLINE       static inline BK_ATTR __attribute__((always_inline))
+
+typedef float BK(vf) __attribute__((vector_size(4 * BK_W)));
+typedef int   BK(vi) __attribute__((vector_size(4 * BK_W)));
+
+BK_INLINE BK(vf) BK(vSplat)(float a)
+{
+    BK(vf) v = { 0 };
+    return v + a;
+}
+
+BK_INLINE BK(vf) BK(vLoad)(const float* p)
+{
+    BK(vf) v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+BK_INLINE void BK(vStore)(float* p, BK(vf) v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Lanes of a where mask is set, lanes of b elsewhere */
+BK_INLINE BK(vf) BK(vSelect)(BK(vi) mask, BK(vf) a, BK(vf) b)
+{
+    return (BK(vf))((mask & (BK(vi))a) | (~mask & (BK(vi))b));
+}
+
+BK_INLINE BK(vf) BK(vFabs)(BK(vf) x)
+{
+    return (BK(vf))((BK(vi))x & 0x7fffffff);
+}
+
+BK_INLINE BK(vf) BK(vSignum)(BK(vf) x)
+{
+    return BK(vSelect)(x > 0, BK(vSplat)(1), BK(vSelect)(x < 0, BK(vSplat)(-1), BK(vSplat)(0)));
+}
+
+BK_INLINE BK(vf) BK(vClamp)(BK(vf) x, float lo, float hi)
+{
+    x = BK(vSelect)(x < lo, BK(vSplat)(lo), x);
+    return BK(vSelect)(x > hi, BK(vSplat)(hi), x);
+}
+
+/*
+ * expf on all the lanes: exp(x) = 2^n * exp(r), |r| <= ln2/2,
+ * exp(r) by the minimax polynomial of Cephes' expf, about 2 ulp
+ */
+BK_INLINE BK(vf) BK(vExp)(BK(vf) x)
+{
+    BK(vf) fx;
+    BK(vf) r;
+    BK(vf) p;
+    BK(vi) n;
+
+    x  = BK(vClamp)(x, -87.3f, 88.3f);
+
+    fx = x * 1.44269504088896341f + 0.5f;
+    n  = __builtin_convertvector(fx, BK(vi));
+    n += (BK(vi))(__builtin_convertvector(n, BK(vf)) > fx);   /* floor, -1 where truncated up */
+    fx = __builtin_convertvector(n, BK(vf));
+
+    r  = x - fx * 0.693359375f + fx * 2.12194440e-4f;
+
+    p  = r * 1.9875691500e-4f + 1.3981999507e-3f;
+    p  = p * r + 8.3334519073e-3f;
+    p  = p * r + 4.1665795894e-2f;
+    p  = p * r + 1.6666665459e-1f;
+    p  = p * r + 5.0000001201e-1f;
+    p  = p * r * r + r + 1;
+
+    return p * (BK(vf))((n + 127) << 23);
+}
+
+/* Linear interpolation of OCV and dOCV in lut, one bin for both, see vBuildLookup in SOC_BATCH.c */
+BK_INLINE void BK(vLookup)(const KalmanBatch* b, BK(vf) z, BK(vf)* ocv, BK(vf)* docv)
+{
+    BK(vf) t;
+    BK(vf) d;
+    BK(vf) v0;
+    BK(vf) s;
+    BK(vf) dv0;
+    BK(vf) ds;
+    BK(vi) j;
+    int    l;
+
+    t  = BK(vClamp)((z - b->soc0) * b->h_inv, 0, b->n_soc - 2);
+    j  = __builtin_convertvector(t, BK(vi));
+    d  = z - (__builtin_convertvector(j, BK(vf)) * b->h + b->soc0);
+
+    for (l = 0; l < BK_W; l++)
+    {
+        v0[l]  = b->lut->matrix[L_OCV][j[l]];
+        s[l]   = b->lut->matrix[L_SOCV][j[l]];
+        dv0[l] = b->lut->matrix[L_DOCV][j[l]];
+        ds[l]  = b->lut->matrix[L_SDOCV][j[l]];
+    }
+
+    *ocv  = v0 + d * s;
+    *docv = dv0 + d * ds;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBatchPredict                                                  *
+*                                                                               *
+* PURPOSE: Kalman Filter Step 1 of the cells [from, to), BK_W at a time,        *
+*           as vEKF_Step1 with EKF_PERCELL                                      *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* u         const float*  I      Current of the cells at time t                 *
+* from      size_t        I      First cell                                     *
+* to        size_t        I      Last cell + 1, to - from multiple of BK_W      *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static BK_ATTR void BK(vBatchPredict)(KalmanBatch* b, const float* u, size_t from, size_t to)
+{
+
+    const float* p   = b->Par.p;
+    float**      st  = b->st->matrix;
+    const float  f0  = b->Par.f0;
+    const float  g0  = b->Par.g0;
+    const float  g2  = b->Par.g2;
+    const float  kg  = b->Par.kg;
+    size_t       c;
+
+    for (c = from; c < to; c += BK_W)
+    {
+        BK(vf) uc  = BK(vLoad)(&u[c]);
+        BK(vf) i   = BK(vLoad)(&st[B_IPREV][c]);
+        BK(vf) sg  = BK(vLoad)(&st[B_ISIGN][c]);
+        BK(vf) xi  = BK(vLoad)(&st[B_XI][c]);
+        BK(vf) xh  = BK(vLoad)(&st[B_XH][c]);
+        BK(vf) xz  = BK(vLoad)(&st[B_XZ][c]);
+        BK(vf) q   = BK(vLoad)(&st[B_Q][c]);
+        BK(vf) si  = BK(vSignum)(i);
+        BK(vf) ea  = BK(vExp)(BK(vFabs)(i) * kg);
+        BK(vf) g1  = kg * ea * (1 + si * xh);
+        BK(vf) p00 = BK(vLoad)(&st[B_P00][c]);
+        BK(vf) p01 = BK(vLoad)(&st[B_P01][c]);
+        BK(vf) p02 = BK(vLoad)(&st[B_P02][c]);
+        BK(vf) p11 = BK(vLoad)(&st[B_P11][c]);
+        BK(vf) p12 = BK(vLoad)(&st[B_P12][c]);
+        BK(vf) p22 = BK(vLoad)(&st[B_P22][c]);
+        BK(vf) ocv;
+        BK(vf) docv;
+
+        uc = BK(vSelect)(uc < 0, uc * p[eta], uc);
+        sg = BK(vSelect)(BK(vFabs)(uc) > b->Par.i_min, BK(vSignum)(uc), sg);
+
+        /* EKF Step 1a */
+        xi = f0 * xi + g0 * i;
+        xh = ea * xh + (ea - 1) * si;
+        xz = xz + g2 * i;
+
+        /* EKF Step 1b, F diagonal: P = F*P*F' + q*g*g' */
+        p00 = f0 * p00 * f0 + g0 * q * g0;
+        p01 = f0 * p01 * ea + g0 * q * g1;
+        p02 = f0 * p02      + g0 * q * g2;
+        p11 = ea * p11 * ea + g1 * q * g1;
+        p12 = ea * p12      + g1 * q * g2;
+        p22 = p22           + g2 * q * g2;
+
+        /* EKF Step 1c, dOCV kept for the update */
+        BK(vLookup)(b, xz, &ocv, &docv);
+        BK(vStore)(&st[B_YP][c], ocv + (p[M0] * sg + p[M] * xh - p[R] * xi - p[R0] * uc));
+        BK(vStore)(&st[B_H2][c], docv);
+
+        BK(vStore)(&st[B_XI][c], xi);
+        BK(vStore)(&st[B_XH][c], xh);
+        BK(vStore)(&st[B_XZ][c], xz);
+        BK(vStore)(&st[B_P00][c], p00);
+        BK(vStore)(&st[B_P01][c], p01);
+        BK(vStore)(&st[B_P02][c], p02);
+        BK(vStore)(&st[B_P11][c], p11);
+        BK(vStore)(&st[B_P12][c], p12);
+        BK(vStore)(&st[B_P22][c], p22);
+        BK(vStore)(&st[B_IPREV][c], uc);
+        BK(vStore)(&st[B_ISIGN][c], sg);
+    }
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBatchUpdate                                                   *
+*                                                                               *
+* PURPOSE: Kalman Filter Step 2 of the cells [from, to), BK_W at a time,        *
+*           as vEKF_Step2 with EKF_PERCELL                                      *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* y         const float*  I      Voltage of the cells at time t                 *
+* from      size_t        I      First cell                                     *
+* to        size_t        I      Last cell + 1, to - from multiple of BK_W      *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static BK_ATTR void BK(vBatchUpdate)(KalmanBatch* b, const float* y, size_t from, size_t to)
+{
+
+    const float* p   = b->Par.p;
+    float**      st  = b->st->matrix;
+    const float  h0  = -p[R];
+    const float  h1  = p[M];
+    size_t       c;
+
+    for (c = from; c < to; c += BK_W)
+    {
+        BK(vf) xi  = BK(vLoad)(&st[B_XI][c]);
+        BK(vf) xh  = BK(vLoad)(&st[B_XH][c]);
+        BK(vf) xz  = BK(vLoad)(&st[B_XZ][c]);
+        BK(vf) p00 = BK(vLoad)(&st[B_P00][c]);
+        BK(vf) p01 = BK(vLoad)(&st[B_P01][c]);
+        BK(vf) p02 = BK(vLoad)(&st[B_P02][c]);
+        BK(vf) p11 = BK(vLoad)(&st[B_P11][c]);
+        BK(vf) p12 = BK(vLoad)(&st[B_P12][c]);
+        BK(vf) p22 = BK(vLoad)(&st[B_P22][c]);
+        BK(vf) h2  = BK(vLoad)(&st[B_H2][c]);
+        BK(vf) k0  = p00 * h0 + p01 * h1 + p02 * h2;
+        BK(vf) k1  = p01 * h0 + p11 * h1 + p12 * h2;
+        BK(vf) k2  = p02 * h0 + p12 * h1 + p22 * h2;
+        BK(vf) s   = BK(vLoad)(&st[B_R][c]) + h0 * k0 + h1 * k1 + h2 * k2;
+        BK(vf) r   = BK(vLoad)(&y[c]) - BK(vLoad)(&st[B_YP][c]);
+        BK(vi) ok;
+
+        k0 /= s;
+        k1 /= s;
+        k2 /= s;
+
+        BK(vStore)(&st[B_YP][c], r);
+
+        /* Gating: where r^2 > 100 s the measurement is discarded */
+        ok = (r * r) <= 100 * s;
+        k0 = BK(vSelect)(ok, k0, BK(vSplat)(0));
+        k1 = BK(vSelect)(ok, k1, BK(vSplat)(0));
+        k2 = BK(vSelect)(ok, k2, BK(vSplat)(0));
+
+        xi += k0 * r;
+        xh += k1 * r;
+        xz += k2 * r;
+
+        p00 -= k0 * s * k0;
+        p01 -= k0 * s * k1;
+        p02 -= k0 * s * k2;
+        p11 -= k1 * s * k1;
+        p12 -= k1 * s * k2;
+        p22 -= k2 * s * k2;
+
+        BK(vStore)(&st[B_XI][c], xi);
+        BK(vStore)(&st[B_XH][c], BK(vClamp)(xh, -1, 1));
+        BK(vStore)(&st[B_XZ][c], BK(vClamp)(xz, 0, 1));
+        BK(vStore)(&st[B_P00][c], p00);
+        BK(vStore)(&st[B_P01][c], p01);
+        BK(vStore)(&st[B_P02][c], p02);
+        BK(vStore)(&st[B_P11][c], p11);
+        BK(vStore)(&st[B_P12][c], p12);
+        BK(vStore)(&st[B_P22][c], p22);
+    }
+
+}
+
+#undef BK_CAT
+#undef BK_XCAT
+#undef BK
+#undef BK_INLINE
@@ -42,6 +42,34 @@
 *   ----          ------            -------- -    ------      ----------------------               *
 *   08-07-2020    N.di Gruttola                     1         Project created				       *
 *                  Giardino																		   *
+*   17-10-2026    agent                             2         Added KalmanWorkspace, no heap usage *
+*                                                              in the EKF steps                    *
+*   17-10-2026    agent                             3         All filter state moved in Kalman,    *
+*                                                              model tables can be shared          *
+*   17-10-2026    agent                             4         Added per-cell engine (EKF_ENGINE)   *
+*   17-10-2026    agent                             5         vGetParam and fSOCfromOCV exported   *
+*                                                              for the batch engine                *
+*   17-10-2026    agent                             6         Pk, Sk and Rk packed symmetric,      *
+*                                                              Kk stored transposed                *
+*   17-10-2026    agent                             7         Fk, D diagonal, Gk, Hk sparse,       *
+*                                                              Pc block diagonal                   *
+*   17-10-2026    agent                             8         OCV tables moved in OCV_MODEL.h,     *
+*                                                              O(1) lookups                        *
+*   17-10-2026    agent                             9         T_cell and docv cached by Step1      *
+*   17-10-2026    agent                             10        ParamCache, parameters interpolated  *
+*                                                              in T and cached with the constants  *
+*   17-10-2026    agent                             11        Temperature of each cell, ParamSet   *
+*   17-10-2026    agent                             12        Measured step dt in vEKF_Step1       *
+*   17-10-2026    agent                             13        vEKF_Step1 and vEKF_Step2 run at     *
+*                                                              independent rates                   *
+*   17-10-2026    agent                             14        Sequential update (EKF_UPDATE)       *
+*   17-10-2026    agent                             15        Parallel groups lumped in one cell   *
+*                                                              (EKF_LUMP_PAR)                      *
+*   17-10-2026    agent                             16        Gain scheduling (EKF_GAIN_SCHED)     *
+*   17-10-2026    agent                             17        Rest fast path (EKF_REST)            *
+*   17-10-2026    agent                             18        Adaptive Rk and Qk (EKF_ADAPT)       *
+*   17-10-2026    agent                             19        Capacity of the cells from the SOH   *
+*                                                              estimator (EKF_SOH)                 *
 *                                                                                                  *
 ***************************************************************************************************/
 
@@ -51,6 +79,7 @@
 /* Include Global Parameters */
 
 #include "matrix.h"
+#include "OCV_MODEL.h"
 #include "libthreads.h"
 
 /* Definition of Macros */
@@ -59,17 +88,166 @@
 	by defining this we're going to modify our system variables according to this.
 	*/
 
+#ifndef PAR
 #define PAR 1
+#endif
+#ifndef SER
 #define SER 1
+#endif
 
-#define Z_IND     	2 * PAR * SER   /*        Index of SOC       */
-#define H_IND     	1 * PAR * SER   /*      Hysteresis index     */
-#define I_IND     	0 * PAR * SER   /*       Current index       */
-#define X_SIZE 	  	3 * PAR * SER   /*    Size of state vector   */
-#define Y_SIZE 	  	PAR * SER       /* Size of the output vector */
-#define U_SIZE 	  	PAR * SER       /*  Size of the input vector */
+/*
+ * EKF_LUMP_PAR 1 models each parallel group as one equivalent cell, fed by the group current:
+ * PAR times the capacity and 1/PAR the resistances of a cell, so X_SIZE is 3*SER.
+ * The PAR cells of a group share one voltage, their own states being unobservable anyway
+ */
+#ifndef EKF_LUMP_PAR
+#define EKF_LUMP_PAR 0
+#endif
+
+#if EKF_LUMP_PAR
+#define LUMP        PAR                 /*  Cells in a modelled cell */
+#else
+#define LUMP        1
+#endif
+
+#define N_PAR       (PAR / LUMP)        /*  Modelled cells sharing a voltage */
+#define N_CELLS     (N_PAR * SER)       /*  Number of modelled cells */
+
+#define Z_IND     	(2 * N_CELLS)   /*        Index of SOC       */
+#define H_IND     	(1 * N_CELLS)   /*      Hysteresis index     */
+#define I_IND     	(0 * N_CELLS)   /*       Current index       */
+#define X_SIZE 	  	(3 * N_CELLS)   /*    Size of state vector   */
+#define Y_SIZE 	  	(N_CELLS)       /* Size of the output vector */
+#define U_SIZE 	  	(N_CELLS)       /*  Size of the input vector */
 #define PARAM_SIZE 	9              /*    Number of parameters   */
 
+/*
+ * EKF engines:
+ *  EKF_DENSE   one filter with X_SIZE states, dense Pk, O(N^3) per step
+ *  EKF_PERCELL one 3-state filter per cell, Fk, Gk and Hk being block diagonal
+ *              the 3x3 blocks of Pk are kept in Pc, O(N) per step.
+ *              Same estimates as EKF_DENSE, the cells being uncorrelated.
+ */
+#define EKF_DENSE   0
+#define EKF_PERCELL 1
+
+#ifndef EKF_ENGINE
+#define EKF_ENGINE  EKF_DENSE
+#endif
+
+/*
+ * Measurement updates of EKF_DENSE:
+ *  EKF_UPD_JOINT all the Y_SIZE outputs at once, Sk factored by Cholesky, O(n^2*m + m^3)
+ *  EKF_UPD_SEQ   one output at a time, as Y_SIZE rank-1 updates with a scalar Sk,
+ *                O(n^2*m) and no factorization: Rk being diagonal, the result is the same.
+ *                Each output is gated on its own, against its sequential Sk
+ */
+#define EKF_UPD_JOINT   0
+#define EKF_UPD_SEQ     1
+
+#ifndef EKF_UPDATE
+#define EKF_UPDATE  EKF_UPD_JOINT
+#endif
+
+/*
+ * EKF_GAIN_SCHED 1, EKF_PERCELL only: the gain and the predicted covariance of the full updates
+ * are cached in bins of (SOC, T, sign of the current), see Kalman.Gs. Once the gain of a bin
+ * has settled, the cells in it take the cached gain and skip the covariance steps, until they
+ * leave the bin, the step changes or their mean normalised innovation squared gets too large:
+ * then they go back to the full update, from the predicted covariance of the bin
+ */
+#ifndef EKF_GAIN_SCHED
+#define EKF_GAIN_SCHED 0
+#endif
+
+#if EKF_GAIN_SCHED && EKF_ENGINE != EKF_PERCELL
+#error "EKF_GAIN_SCHED needs EKF_ENGINE == EKF_PERCELL"
+#endif
+
+#define GS_SOC_BINS 20                  /* SOC bins, of 1/GS_SOC_BINS */
+#define GS_T_MIN    -20.0f              /* Lower edge of the first temperature bin */
+#define GS_T_RES    5.0f                /* Temperature bins, in degrees */
+#define GS_T_BINS   14                  /* Temperature bins, up to GS_T_MIN + GS_T_BINS*GS_T_RES */
+#define GS_BINS     (GS_SOC_BINS * GS_T_BINS * 3)
+
+/* The measured steps jitter around the period: a gain holds for the steps within GS_DT_TOL of its own */
+#define GS_DT_SAME(g, dt)   (fabsf((g) - (dt)) <= GS_DT_TOL * (dt))
+
+#ifndef GS_K_TOL
+#define GS_K_TOL    1e-4f               /* Change of the gain between two updates, relative, for it to be steady */
+#endif
+#ifndef GS_DT_TOL
+#define GS_DT_TOL   0.05f               /* Change of the step, relative, still on the gain of the bin */
+#endif
+#ifndef GS_SETTLE
+#define GS_SETTLE   10                  /* Full updates with a steady gain before the bin is used */
+#endif
+#ifndef GS_NIS_MAX
+#define GS_NIS_MAX  3.0f                /* Mean normalised innovation squared that ends the scheduling */
+#endif
+#define GS_NIS_A    0.05f               /* Weight of the last innovation in that mean */
+
+/* Columns of Kalman.Gs, one row per bin */
+#define GS_K        0                   /* Gain, CELL_STATES columns */
+#define GS_S        3                   /* Innovation variance */
+#define GS_DT       4                   /* Step of the first steady gain, see GS_DT_SAME */
+#define GS_N        5                   /* Full updates with a steady gain, up to GS_SETTLE */
+#define GS_PM       6                   /* Predicted covariance, CELL_STATES^2 columns */
+#define GS_COLS     15
+
+/*
+ * EKF_REST 1: a cell whose current stays under Q/100 (the i_sign threshold) is at rest. Its
+ * covariance steps are deferred, then applied at once in closed form, the current taken as 0,
+ * see vRestFlush. Its voltage updates are skipped while the voltage stays within REST_DV of the
+ * last update, but one in REST_UPD_DIV runs anyway, as an OCV correction.
+ * EKF_DENSE defers only when all the cells are at rest
+ */
+#ifndef EKF_REST
+#define EKF_REST 0
+#endif
+
+#ifndef REST_DV
+#define REST_DV         2e-3f           /* Change of the voltage since the last update still at rest, in V */
+#endif
+#ifndef REST_UPD_DIV
+#define REST_UPD_DIV    60              /* Updates at rest, one of them being run */
+#endif
+
+/*
+ * Adaptive noise (EKF_ADAPT): the innovations of the last ADAPT_WIN updates of a cell estimate
+ *  ADAPT_R  its Rk, mean of r^2 - h*Pk*h', r^2 clipped at the gating bound
+ *  ADAPT_RQ also its Qk, mean of (g'*Kk*r)^2/|g|^4, g being its column of Gk
+ * The windows are rings with running sums, O(1) per cell and update, see vAdaptNoise.
+ * Until a window is full the values of vSetup are kept
+ */
+#define ADAPT_OFF   0
+#define ADAPT_R     1
+#define ADAPT_RQ    2
+
+#ifndef EKF_ADAPT
+#define EKF_ADAPT   ADAPT_OFF
+#endif
+
+#ifndef ADAPT_WIN
+#define ADAPT_WIN   64                  /* Updates in the window */
+#endif
+#ifndef ADAPT_R_MIN
+#define ADAPT_R_MIN 1e-2f               /* Lower bound of the estimated Rk, in V^2: the model error of the cell */
+#endif
+#ifndef ADAPT_Q_MIN
+#define ADAPT_Q_MIN 1e-4f               /* Lower bound of the estimated Qk, in A^2 */
+#endif
+
+/*
+ * EKF_SOH 1: the SOC steps of a cell are scaled by Kalman.q_ratio, its nominal capacity
+ * Param[Q] over its estimated one, published by the SOH estimator of SOH_RLS.h
+ */
+#ifndef EKF_SOH
+#define EKF_SOH 0
+#endif
+
+#define CELL_STATES 3                   /* States of a cell: current, hysteresis, SOC */
+
 /* Indexes of Dynamic Cell  */
 #define TIME 		0
 #define CURRENT 	1
@@ -87,19 +265,22 @@
 #define eta 		7
 #define TEMP 		8
 
-/* Frequency */
+/* Nominal step in s, the steps take the measured one, see vEKF_Step1 */
 #define DeltaT 		1
 
-/* Indexes of Cell SOC_OCv relationship */
-#define OCV 		0
-#define OCV0 		1
-#define OCVrel 		2
-#define SOC 		3
-#define SOC0 		4
-#define SOCrel 		5
-#define dOCV0 		6
-#define dOCVrel 	7
-#define OvSLenght 	8
+/*
+ * Resolution of the step in s: the steps use dt rounded to a multiple of it,
+ * the rounding error carried to the next step, so that the decays of a slot
+ * are recomputed only when the rounded dt changes. 0 uses dt as it is
+ */
+#ifndef DT_RES
+#define DT_RES      1e-3f
+#endif
+
+/* Temperature buckets of the ParamCache, in degrees: 0 recomputes at every change of T */
+#ifndef PARAM_T_RES
+#define PARAM_T_RES 0.1f
+#endif
 
 /* Paths to Cell Dynamic Data */
 #define PATH_T 		"./csv/CellDataTime.csv"
@@ -111,33 +292,133 @@
 #define DEBUG3 		0
 #define DEBUG_PRINT 0
 
+/* Scratch matrices of the EKF steps, sized once in vSetup so that the steps never allocate */
+typedef struct KalmanWorkspace
+{
+
+	Matrix* GQ;		/* X_SIZE x U_SIZE Gk*Qk, scratch of iCovPropagate */
+	Matrix* HP;		/* Y_SIZE x X_SIZE Hk*Pk      */
+	SymMatrix* SU;	/* Y_SIZE x Y_SIZE Cholesky factor of Sk, Sk = SU'*SU */
+	Matrix* KS;		/* Y_SIZE x X_SIZE Sk*Kk'     */
+	Matrix* PH;		/* X_SIZE x 1 Pk*h', h a row of Hk, EKF_UPD_SEQ only */
+	Matrix* DX;		/* X_SIZE x 1 correction of the outputs done, EKF_UPD_SEQ only */
+
+} KalmanWorkspace;
+
+/* Cell model parameters at a temperature, with the constants of the steps derived from them */
+typedef struct ParamCache
+{
+
+	float T;						/* Temperature bucket of the cache, NAN when empty */
+	float dt;						/* Step of f0, g0, g2 and kg, NAN when they are not computed */
+	float p[PARAM_SIZE - 1];		/* Parameters at T, interpolated between the model temperatures */
+	float q;						/* 3600*Q, capacity in As */
+	float i_min;					/* Q/100, smallest current that sets i_sign */
+	float f0;						/* exp(-dt/|RC|), decay of the RC current */
+	float g0;						/* 1 - f0 */
+	float g2;						/* -dt/(3600*Q), SOC change per A */
+	float kg;						/* -|G*dt/(3600*Q)|, hysteresis exponent per A */
+
+} ParamCache;
+
+/*
+ * ParamCaches of the cells, see vGetParamBatch: the cells in the same temperature
+ * bucket share one slot, so the parameters are computed once per distinct bucket
+ */
+typedef struct ParamSet
+{
+
+	ParamCache slot[U_SIZE];		/* Slots, keyed by their bucket */
+	int        of[U_SIZE];			/* Slot of each cell */
+	int        ref[U_SIZE];			/* Cells in each slot, 0 for a free slot */
+
+} ParamSet;
+
+/* ParamCache of cell c of the Kalman k */
+#define CELL_PAR(k, c)  (&(k)->Par.slot[(k)->Par.of[c]])
+
+/* Covariance steps of a cell at rest, deferred, see EKF_REST */
+typedef struct RestCell
+{
+
+	int   n;						/* Steps not yet applied to the covariance */
+	float T;						/* Temperature bucket of those steps, see ParamCache */
+	float rc;						/* |RC|, in s */
+	float ck;						/* kg and g2 per s of step */
+	float c2;
+	float s1;						/* Sum of their dt */
+	float s2;						/* Sum of their dt^2 */
+	float y;						/* Voltage of the last update, NAN before the first */
+	int   skip;						/* Updates skipped since the last one */
+
+} RestCell;
+
+/* Innovation windows of the cells, see EKF_ADAPT */
+typedef struct NoiseWindow
+{
+
+	Matrix* e;						/* ADAPT_WIN x 2*N_CELLS, samples of Rk (column c) and Qk (column N_CELLS + c) */
+	double  sum[2 * N_CELLS];		/* Sums of the columns of e, double so that they do not drift */
+	int     pos[N_CELLS];			/* Row of the next sample of each cell */
+	int     n[N_CELLS];				/* Samples of each cell, up to ADAPT_WIN */
+
+} NoiseWindow;
+
 /* Kalman variables structure */
 typedef struct Kalman
 {
 
 	Matrix* x;
-	Matrix* Pk;		
-	Matrix* Fk;		
-	Matrix* Gk;		
-	Matrix* Hk;		
+	SymMatrix* Pk;							/* Packed upper triangle, exactly symmetric */
+	DiagMatrix* Fk;		
+	SpMatrix* Gk;							/* One element per row, the cell's input */
+	SpMatrix* Hk;							/* CELL_STATES elements per row, the cell's states */
 	Matrix* Qk;		
-	Matrix* Rk;		
+	SymMatrix* Rk;		
 	Matrix* OvS;
 	Matrix *Param;
-	Matrix *D;
-	Matrix *Kk;
-	Matrix *Sk;
+	OCVModel *Ocv;							/* OvS resampled on uniform grids, built in vSetup */
+	DiagMatrix *D;
+	Matrix *Kk;								/* Stored transposed, Y_SIZE x X_SIZE */
+	SymMatrix *Sk;
 	Matrix *y_p;
+	Matrix *int_Gku;						/* Used to compute G*u */
+	BlkDiagMatrix *Pc;						/* EKF_PERCELL: Pk blocks, block c for cell c */
+	Matrix *Gs;								/* EKF_GAIN_SCHED: GS_BINS x GS_COLS, cached gains */
+
+	float   i_prev[U_SIZE];					/* Current at the previous step */
+	int     i_sign[U_SIZE];					/* Sign of the last non-negligible current */
+	float   docv[U_SIZE];					/* dOCV at the predicted SOC, scratch of vEKF_Step2 */
+	ParamSet Par;							/* Parameters of the cells at time t, see CELL_PAR */
+	float   dt_carry;						/* Rounding error of the last step, see DT_RES */
+	int     gs_of[U_SIZE];					/* EKF_GAIN_SCHED: bin of the cell's gain, -1 for the full update */
+	float   gs_nis[U_SIZE];					/* EKF_GAIN_SCHED: mean normalised innovation squared */
+	RestCell rest[U_SIZE];					/* EKF_REST: deferred steps of the cells */
+	NoiseWindow Nw;							/* EKF_ADAPT: innovations of the cells */
+	float   q_ratio[U_SIZE];				/* EKF_SOH: nominal over estimated capacity of the cells */
+	int     shared;							/* OvS, Ocv and Param belong to another filter, see vSetup */
+
+	KalmanWorkspace ws;
 
 } Kalman;
 
 
 /* Declare Prototypes */
 
-void vSetup		(Kalman *, const float, const float*);
-void vEKF_Step1	(Kalman *, float *, const float);
-void vEKF_Step2	(Kalman *, float *, const float);
+void vSetup		(Kalman *, const float *, const float*, const Kalman *);
+void vEKF_Step1	(Kalman *, float *, const float *, const float);
+void vEKF_Step2	(Kalman *, float *, const float *);
 void vDelete	(Kalman *);
+float fGetSOC	(const Kalman *, size_t);
+float fGetSOCVar(const Kalman *, size_t);
+
+/* Cell model, also used by the batch engine (SOC_BATCH.h) */
+void  vGetParam	 (float *, const float, const Matrix *);
+float fParamBucket(const float);
+void  vParamCacheUpdate(ParamCache *, const float, const Matrix *);
+void  vParamCacheStep(ParamCache *, const float);
+void  vGetParamBatch(ParamSet *, const float *, const float, const Matrix *);
+float fStepDt	 (float *, const float);
 
 
 #endif /* SOC_EKF_h */
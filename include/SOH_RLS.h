@@ -0,0 +1,133 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+
+/***************************************************************************************************
+*   FILENAME:  SOH_RLS.h                                                                           *
+*                                                                                                  *
+*                                                                                                  *
+*   PURPOSE:   Library that defines the object Soh and all its functions.                          *
+*              A Soh estimates the capacity of the cells at a low rate, by recursive least         *
+*              squares: between two rests the SOC change of a cell, read on the OCV, is its        *
+*              coulomb count at the nominal capacity times Q_nominal / Q. The OCV is the           *
+*              voltage less the overpotentials of the EKF's states.                                *
+*              The Kalman thread feeds it and reads its estimates, the SOH thread runs             *
+*              the least squares, through a lock-free single producer, single consumer             *
+*              queue: neither thread ever waits for the other                                      *
+*                                                                                                  *
+*                                                                                                  *
+*   GLOBAL VARIABLES:                                                                              *
+*                                                                                                  *
+*                                                                                                  *
+*   Variable        Type          Description                                                      *
+*   --------        ----          -------------------                                              *
+*   h               Soh           Soh object                                                       *
+*                                                                                                  *
+*   DEVELOPMENT HISTORY :                                                                          *
+*                                                                                                  *
+*                                                                                                  *
+*   Date          Author            Change Id     Release     Description Of Change                *
+*   ----          ------            -------- -    ------      ----------------------               *
+*   17-10-2026    agent                             1         Project created                      *
+*                                                                                                  *
+***************************************************************************************************/
+
+#ifndef SOH_RLS_h
+#define SOH_RLS_h
+
+/* Include Global Parameters */
+
+#include <stdatomic.h>
+#include "SOC_EKF.h"
+
+/* Definition of Macros */
+
+#ifndef SOH_DIV
+#define SOH_DIV     60                  /* Steps of the EKF per sample of the queue */
+#endif
+#ifndef SOH_QLEN
+#define SOH_QLEN    16                  /* Samples in the queue, a power of 2 */
+#endif
+#ifndef SOH_REST
+#define SOH_REST    2                   /* Samples at rest before the OCV is read */
+#endif
+#ifndef SOH_DZ_MIN
+#define SOH_DZ_MIN  0.1f                /* Nominal SOC change between two rests for a least squares point */
+#endif
+#ifndef SOH_LAMBDA
+#define SOH_LAMBDA  0.995f              /* Forgetting factor of the least squares, per point */
+#endif
+#define SOH_P0      100.0f              /* Initial covariance of Q_nominal / Q, over the SOC noise */
+#define SOH_MIN     0.5f                /* Bounds of the estimated Q / Q_nominal */
+#define SOH_MAX     1.2f
+
+#if (SOH_QLEN & (SOH_QLEN - 1)) != 0
+#error "SOH_QLEN must be a power of 2"
+#endif
+
+/* Sample of the queue: the cells over an interval of SOH_DIV steps */
+typedef struct SohSample
+{
+
+	float v[N_CELLS];					/* Voltage less the overpotentials, at the end */
+	float T[N_CELLS];					/* Temperature, at the end */
+	float dz[N_CELLS];					/* SOC change at the nominal capacity */
+	int   rest[N_CELLS];				/* 1 if the current stayed under Q/100 */
+
+} SohSample;
+
+/* SOH estimator structure */
+typedef struct Soh
+{
+
+	/* Kalman thread */
+	SohSample    acc;					/* Sample being accumulated */
+	float        i_last[N_CELLS];		/* Current of the last step of the EKF */
+	int          n_acc;					/* Steps in acc */
+	unsigned int full;					/* Samples kept in acc, the queue being full */
+
+	/* Queue, head written by the Kalman thread, tail by the SOH thread */
+	SohSample    q[SOH_QLEN];
+	atomic_uint  head;					/* Samples pushed */
+	atomic_uint  tail;					/* Samples popped */
+
+	/* SOH thread */
+	const OCVModel* Ocv;				/* Cell model tables, owned by the Kalman */
+	_Atomic float pub[N_CELLS];			/* Published Q_nominal / Q, read by the Kalman thread */
+	float        phi[N_CELLS];			/* Estimated Q_nominal / Q */
+	float        P[N_CELLS];			/* Its covariance, over the SOC noise */
+	float        z_rest[N_CELLS];		/* SOC read at the last rest, NAN before the first */
+	float        ax[N_CELLS];			/* Nominal SOC change since that rest */
+	int          n_rest[N_CELLS];		/* Samples at rest in a row */
+
+} Soh;
+
+
+/* Declare Prototypes */
+
+void  vSohSetup	(Soh *, const Kalman *);
+void  vSohFeed	(Soh *, Kalman *, const float *);
+void  vSohUpdate(Soh *);
+float fGetSOH	(const Soh *, size_t);
+
+
+#endif /* SOH_RLS_h */
@@ -45,6 +45,7 @@
 *   ----          ------            -------- -    ------      ----------------------               *
 *   08-07-2020    N.di Gruttola                     1         Project created				       *
 *                  Giardino																		   *
+*   17-10-2026    agent                             2         fRt_elapsed                          *
 *                                                                                                  *
 ***************************************************************************************************/
 /* Include Global Parameters */
@@ -260,6 +261,7 @@ void vTs_minus(struct timespec *ts_end, struct timespec *ts_start, struct timesp
 void vTs_plus(struct timespec *ts_a, struct timespec *ts_b, struct timespec *ts_sum);
 void vTs_normalize(struct timespec *ts);
 long lRt_gettime();
+float fRt_elapsed(struct timespec *last);
 
 void vInitLogger(float val[]);
 void vStoreData(float val[], size_t index);
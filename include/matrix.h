@@ -34,7 +34,20 @@
 *   Variable        Type        Description                                                        *
 *   --------        ----        -------------------                                                *
 *   m               Matrix      Matrix object, contains                                            *
-*                                a float**, being the matrix, and 2 int, being rows and columns    *
+*                                a float*, being the row-major storage, a float** row view of it,  *
+*                                and 2 int, being rows and columns                                 *
+*                                                                                                  *
+*   s               SymMatrix   Symmetric matrix object, contains                                  *
+*                                a float*, being the packed upper triangle, and 1 int, being rows  *
+*                                                                                                  *
+*   d               DiagMatrix  Diagonal matrix object, contains                                   *
+*                                a float*, being the diagonal, and 1 int, being rows               *
+*                                                                                                  *
+*   b               BlkDiagMatrix Block diagonal matrix object, contains                           *
+*                                a float*, being the blocks one after the other, and 2 int,        *
+*                                being the size of a block and the no. of blocks                   *
+*                                                                                                  *
+*   sp              SpMatrix    Sparse matrix object, compressed sparse rows                       *
 *                                                                                                  *
 *   v           Vector      Vector object, contains                                                *
 *                             a float*, being the vector, and 1 int, being rows                    *
@@ -58,6 +71,27 @@
 *                   Giardino &                                  nomenclature                       *
 *                G. Di Cecio                                                                       *
 *                                                                                                  *
+*   17-10-2026   agent                              3         Matrix stored in a single aligned,   *
+*                                                              row-major block                     *
+*                                                                                                  *
+*   17-10-2026   agent                              4         iChol fails on non positive definite *
+*                                                              matrices, added iCholSolve          *
+*                                                                                                  *
+*   17-10-2026   agent                              5         Added iCovPropagate                  *
+*                                                                                                  *
+*   17-10-2026   agent                              6         Added iGemm                          *
+*                                                                                                  *
+*   17-10-2026   agent                              7         SIMD tile kernels of iGemm,          *
+*                                                              MATRIX_BITEXACT                     *
+*                                                                                                  *
+*   17-10-2026   agent                              8         Added SymMatrix, packed symmetric    *
+*                                                              storage, iCovPropagate on it        *
+*                                                                                                  *
+*   17-10-2026   agent                              9         Added DiagMatrix, BlkDiagMatrix and  *
+*                                                              SpMatrix (CSR)                      *
+*                                                                                                  *
+*   17-10-2026   agent                              10        Added iSymSpRowMult and iSymRank1    *
+*                                                                                                  *
 ***************************************************************************************************/
 
 #ifndef MATRIX_h
@@ -82,6 +116,31 @@
         (retf == 0 ? 0 : (retf < 0 ? -1 : 1)); \
     })
 
+#define MATRIX_ALIGN    32      /* Alignment in bytes of the matrix storage (AVX register size) */
+
+/* Operand flags of iGemm */
+#define MAT_NOTRANS     0
+#define MAT_TRANS       1
+
+/* Tile kernels of iGemm, see iSetKernel */
+#define MAT_KERNEL_SCALAR   0
+#define MAT_KERNEL_SSE      1
+#define MAT_KERNEL_AVX2     2
+
+/* 1: no FMA in the AVX2 kernel, every kernel gives the same results as the scalar one */
+#ifndef MATRIX_BITEXACT
+#define MATRIX_BITEXACT     0
+#endif
+
+/* Element (i,j) of the row-major storage, to be used instead of the row view in the kernels */
+#define MAT(m, i, j)    ((m)->data[(size_t)(i) * (m)->c + (j)])
+
+/* Element (i,j), i <= j, of the packed upper triangle of a SymMatrix */
+#define SYM(s, i, j)    ((s)->data[(size_t)(i) * (2 * (size_t)(s)->n - (i) - 1) / 2 + (j)])
+
+/* Element (i,j) of the block k of a BlkDiagMatrix */
+#define BLK(m, k, i, j) ((m)->data[((size_t)(k) * (m)->b + (i)) * (m)->b + (j)])
+
 /*
 * Matrix Object:
 *       float** being the pointer to the matrix
@@ -95,7 +154,8 @@ static int heap_usage = 0;
 
 /*
 * Matrix Object:
-*       float** being the pointer to the matrix
+*       float*  being the row-major storage, r*c floats in one MATRIX_ALIGN aligned block
+*       float** being the row view on the storage, matrix[i] == &data[i*c]
 *       int c and r are no. of columns and no. of rows
 */
 
@@ -104,8 +164,67 @@ typedef struct Matrix
     float** matrix;
     unsigned int     c;
     unsigned int     r;
+    float*  data;
 }Matrix;
 
+/*
+* SymMatrix Object:
+*       float*  being the upper triangle, packed row by row, n*(n+1)/2 floats
+*               in one MATRIX_ALIGN aligned block: row i holds (i,i)..(i,n-1)
+*       int n is the no. of rows and columns
+*/
+
+typedef struct SymMatrix
+{
+    float*  data;
+    unsigned int     n;
+}SymMatrix;
+
+/*
+* DiagMatrix Object:
+*       float*  being the diagonal, n floats, the other elements being 0
+*       int n is the no. of rows and columns
+*/
+
+typedef struct DiagMatrix
+{
+    float*  d;
+    unsigned int     n;
+}DiagMatrix;
+
+/*
+* BlkDiagMatrix Object:
+*       float*  being the nb blocks of b x b, row-major, one after the other
+*       int b is the size of a block, nb the no. of blocks, b*nb rows and columns
+*/
+
+typedef struct BlkDiagMatrix
+{
+    float*  data;
+    unsigned int     b;
+    unsigned int     nb;
+}BlkDiagMatrix;
+
+/*
+* SpMatrix Object, compressed sparse rows:
+*       float*  val being the stored elements, row by row, increasing columns
+*       int*    col being the column of each stored element
+*       int*    row_ptr being the first stored element of each row, r+1 entries
+*       int c and r are no. of columns and no. of rows,
+*       nnz the no. of stored elements, cap the room for them
+*/
+
+typedef struct SpMatrix
+{
+    float*  val;
+    unsigned int*    col;
+    unsigned int*    row_ptr;
+    unsigned int     c;
+    unsigned int     r;
+    unsigned int     nnz;
+    unsigned int     cap;
+}SpMatrix;
+
 typedef struct Vector
 {
     float* vector;
@@ -122,7 +241,36 @@ void     vVectorDestroy  (Vector *);
 int      iSum            (Matrix*, Matrix *, Matrix *);   
 Matrix*  pxSum           (Matrix*, Matrix*);              
 int      iMultiply       (Matrix*, Matrix *, Matrix *);   
+int      iGemm           (Matrix*, Matrix *, int, Matrix *, int, float, float);
+int      iSetKernel      (int);
+int      iGetKernel      ();
 Matrix*  pxMultiply      (Matrix*, Matrix*);              
+int      iCovPropagate   (SymMatrix*, DiagMatrix *, SpMatrix *, Matrix *, Matrix *);
+SymMatrix* pxSymCreate   (unsigned int);
+void     vSymDestroy     (SymMatrix *);
+int      iSymSum         (SymMatrix*, SymMatrix *, SymMatrix *);
+int      iSymSubtract    (SymMatrix*, SymMatrix *, SymMatrix *);
+int      iSymCongruence  (SymMatrix*, Matrix *, int, SymMatrix *, float, float, Matrix *);
+int      iSymChol        (SymMatrix*, SymMatrix *);
+int      iSymCholSolve   (Matrix*, SymMatrix *, Matrix *);
+void     vSymPrint       (SymMatrix *);
+DiagMatrix* pxDiagCreate (unsigned int);
+void     vDiagDestroy    (DiagMatrix *);
+int      iDiagGemm       (Matrix*, DiagMatrix *, Matrix *, float, float);
+int      iSymDiagCongruence (SymMatrix*, DiagMatrix *, SymMatrix *, float, float);
+void     vDiagPrint      (DiagMatrix *);
+BlkDiagMatrix* pxBlkDiagCreate (unsigned int, unsigned int);
+void     vBlkDiagDestroy (BlkDiagMatrix *);
+int      iBlkDiagGemm    (Matrix*, BlkDiagMatrix *, Matrix *, float, float);
+void     vBlkDiagPrint   (BlkDiagMatrix *);
+SpMatrix* pxSpCreate     (unsigned int, unsigned int, unsigned int);
+void     vSpDestroy      (SpMatrix *);
+int      iSpInsert       (SpMatrix*, unsigned int, unsigned int, float);
+float*   pxSpEntry       (SpMatrix*, unsigned int, unsigned int);
+int      iSymSpCongruence (SymMatrix*, SpMatrix *, SymMatrix *, float, float, Matrix *);
+int      iSymSpRowMult   (Matrix*, SpMatrix *, unsigned int, SymMatrix *);
+int      iSymRank1       (SymMatrix*, Matrix *, float);
+void     vSpPrint        (SpMatrix *);
 int      iSubtract       (Matrix*, Matrix *, Matrix *);   
 Matrix*  pxSubtract      (Matrix*, Matrix*);              
 int      iSc_Multiply    (Matrix*, Matrix *, float);      
@@ -144,6 +292,7 @@ Matrix*  pxCopy          (Matrix*);
 int      iRowSwap        (Matrix *, unsigned int, unsigned int);            
 int      iReduce         (Matrix *, unsigned int , unsigned int , float);   
 int      iChol           (Matrix*, Matrix *);             
+int      iCholSolve      (Matrix*, Matrix *, Matrix *);   
 Matrix*  pxChol          (Matrix*);                       
 int      iLU             (Matrix *, Matrix *, Matrix *);  
 int      iSqrtm          (Matrix*, Matrix *);             
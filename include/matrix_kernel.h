@@ -0,0 +1,151 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/***************************************************************************************************
+*   FILENAME:  matrix_kernel.h                                                                     *
+*                                                                                                  *
+*                                                                                                  *
+*   PURPOSE:   Register blocked tile kernel of iGemm, written once on GCC vectors of MK_W          *
+*              floats. Only to be included by matrix.c, once per instruction set, with:            *
+*                MK_W       lanes of the vectors                                                   *
+*                MK_MR      rows of the C tile                                                     *
+*                MK_NV      vectors per row of the C tile, i.e. MK_NV*MK_W columns                 *
+*                MK_SUFFIX  suffix of the generated names                                          *
+*                MK_ATTR    function attributes, i.e. the target instruction set                   *
+*              Every element of C adds its products one by one in increasing k,                    *
+*              so without FMA all the instruction sets give the same results.                      *
+*                                                                                                  *
+*   DEVELOPMENT HISTORY :                                                                          *
+*                                                                                                  *
+*                                                                                                  *
+*   Date          Author            Change Id     Release     Description Of Change                *
+*   ----          ------            -------- -    ------      ----------------------               *
+*   17-10-2026    agent                             1         Project created                      *
+*                                                                                                  *
+***************************************************************************************************/
+
+#if !defined(MK_W) || !defined(MK_MR) || !defined(MK_NV) || !defined(MK_SUFFIX) || !defined(MK_ATTR)
+#error "matrix_kernel.h is only to be included by matrix.c"
+#endif
+
+#define MK_CAT(a, b)    a##b
+#define MK_XCAT(a, b)   MK_CAT(a, b)
+#define MK(name)        MK_XCAT(name, MK_SUFFIX)
+#define MK_NR           (MK_NV * MK_W)
+
+typedef float MK(vf) __attribute__((vector_size(4 * MK_W)));
+
+/*
+ * C tile of mr x MK_NR: C(r, j) += alpha*A(r, k) * Bp(k, j) for k = 0..kc-1,
+ * A read through its strides, Bp packed by gemm_pack_b with MK_NR columns
+ */
+static inline MK_ATTR __attribute__((always_inline))
+void MK(gemm_tile_body)(float* C, size_t ldc, const float* A, size_t as_i, size_t as_k,
+                        const float* Bp, size_t kc, float alpha, const size_t mr)
+{
+    MK(vf) acc[MK_MR][MK_NV];
+    MK(vf) b[MK_NV];
+    size_t r;
+    size_t v;
+    size_t k;
+
+    /* Fully unrolled, so that the accumulators stay in registers */
+#pragma GCC unroll 8
+    for (r = 0; r < mr; r++)
+#pragma GCC unroll 4
+        for (v = 0; v < MK_NV; v++)
+            memcpy(&acc[r][v], &C[r * ldc + v * MK_W], sizeof(MK(vf)));
+
+    for (k = 0; k < kc; k++)
+    {
+#pragma GCC unroll 4
+        for (v = 0; v < MK_NV; v++)
+            memcpy(&b[v], &Bp[k * MK_NR + v * MK_W], sizeof(MK(vf)));
+
+#pragma GCC unroll 8
+        for (r = 0; r < mr; r++)
+        {
+            const float a = alpha * A[r * as_i + k * as_k];
+#pragma GCC unroll 4
+            for (v = 0; v < MK_NV; v++)
+                acc[r][v] += a * b[v];
+        }
+    }
+
+#pragma GCC unroll 8
+    for (r = 0; r < mr; r++)
+#pragma GCC unroll 4
+        for (v = 0; v < MK_NV; v++)
+            memcpy(&C[r * ldc + v * MK_W], &acc[r][v], sizeof(MK(vf)));
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: gemm_tile                                                      *
+*                                                                               *
+* PURPOSE: Computes a tile of C of mr <= MK_MR rows and nr <= MK_NR columns,    *
+*           full tiles in registers, the others through a local tile            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* C         float*        IO     First element of the tile                      *
+* ldc       size_t        I      Row stride of C                                *
+* A         const float*  I      op(A)(i, k) of the first row of the tile       *
+* as_i      size_t        I      Stride of op(A) along i                        *
+* as_k      size_t        I      Stride of op(A) along k                        *
+* Bp        const float*  I      Packed panel of op(B), kc x MK_NR              *
+* kc        size_t        I      Depth of the panel                             *
+* alpha     float         I      Scale of the product                           *
+* mr        size_t        I      Rows of the tile                               *
+* nr        size_t        I      Columns of the tile                            *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static MK_ATTR void MK(gemm_tile)(float* C, size_t ldc, const float* A, size_t as_i, size_t as_k,
+                                  const float* Bp, size_t kc, float alpha, size_t mr, size_t nr)
+{
+    float  t[MK_MR * MK_NR];
+    size_t r;
+
+    if (mr == MK_MR && nr == MK_NR)
+    {
+        MK(gemm_tile_body)(C, ldc, A, as_i, as_k, Bp, kc, alpha, MK_MR);
+        return;
+    }
+
+    for (r = 0; r < mr; r++)
+        memcpy(&t[r * MK_NR], &C[r * ldc], nr * sizeof(float));
+
+    MK(gemm_tile_body)(t, MK_NR, A, as_i, as_k, Bp, kc, alpha, mr);
+
+    for (r = 0; r < mr; r++)
+        memcpy(&C[r * ldc], &t[r * MK_NR], nr * sizeof(float));
+}
+
+#undef MK_CAT
+#undef MK_XCAT
+#undef MK
+#undef MK_NR
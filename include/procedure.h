@@ -45,22 +45,54 @@
 *   ----          ------            -------- -    ------      ----------------------               *
 *   08-07-2020    N.di Gruttola                     1         Project created				       *
 *                  Giardino																		   *
+*   17-10-2026    agent                             2         KALMAN_PERIOD_NS, EKF_UPDATE_DIV     *
+*   17-10-2026    agent                             3         SOH estimator thread (EKF_SOH)       *
 *                                                                                                  *
 ***************************************************************************************************/
 
 /* Include Global Parameters */
 #include "SOC_EKF.h"
+#include "SOH_RLS.h"
 
 /* Definition of Macros */
 
 #define SOC_RANGE           0.05f   /* Maximum difference in SoC between two cells */
 
-#define NTHREADS			2       /* Number of threads to be created */
+/* The balancing message has one bit per cell, see vKalmanLoop */
+#if PAR * SER > 64
+#error "PAR * SER must not exceed the 64 bits of the balancing message"
+#endif
+
+#if EKF_SOH
+#define NTHREADS			3       /* Number of threads to be created */
+#else
+#define NTHREADS			2
+#endif
 #define KALMAN              0           /* Kalman thread index */
 #define END                 1            /* End thread index */
+#define SOH_EST             2           /* SOH estimator thread index */
 
 #define RASPI_SOC           1
 
+/* Period of the Kalman thread: of the samples and of vEKF_Step1 */
+#ifndef KALMAN_PERIOD_NS
+#if RASPI_SOC
+#define KALMAN_PERIOD_NS    (1 * NS_PER_SEC)
+#else
+#define KALMAN_PERIOD_NS    (15 * NS_PER_MS)
+#endif
+#endif
+
+/* Multi-rate EKF: vEKF_Step2, the voltage update, once every EKF_UPDATE_DIV periods */
+#ifndef EKF_UPDATE_DIV
+#define EKF_UPDATE_DIV      1
+#endif
+
+/* Period of the SOH thread, the queue filling in SOH_QLEN * SOH_DIV Kalman periods */
+#ifndef SOH_PERIOD_NS
+#define SOH_PERIOD_NS       (1 * NS_PER_SEC)
+#endif
+
 #if RASPI_SOC
 
 #include <wiringPi.h>
@@ -82,6 +114,7 @@ struct KalmanForThread                  /* Structure containing the argument to
 {
 
     Kalman  k;                          /* Kalman structure definition */
+    Soh     soh;                        /* SOH estimator, fed by the Kalman thread (EKF_SOH) */
     struct threads thread[NTHREADS];    /* Thread strucutre definition */
 
 };
@@ -99,10 +132,12 @@ int iGetExit();
 /* Threads Prototypes */
 void* pvKalmanThread(void* arg);
 void* pvEndThread();
+void* pvSohThread(void* arg);
 
 /* Periodic and Aperiodic Functions*/
 void vKalmanLoop(Kalman* k, int s);
 void vEndLoop(int s);
+void vSohLoop(Soh* h);
 
 #ifdef RASPI_SOC
 /* Define lcd 16x2 display functions */
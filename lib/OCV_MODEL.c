@@ -0,0 +1,852 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/****************************************************************************************************
+* FILE NAME: OCV_MODEL.c                                                                            *
+*                                                                                                   *
+* PURPOSE: This library implements the OCVModel, the OCV vs SOC tables of the cell model            *
+*           resampled on uniform grids at model load time, with O(1) lookups                        *
+*                                                                                                   *
+* FILE REFERENCES:                                                                                  *
+*                                                                                                   *
+*   Name    I/O     Description                                                                     *
+*   ----    ---     -----------                                                                     *
+*   none                                                                                            *
+*                                                                                                   *
+*                                                                                                   *
+* EXTERNAL VARIABLES:                                                                               *
+*                                                                                                   *
+* Source: <OCV_MODEL.h>                                                                             *
+*                                                                                                   *
+* Name          Type        IO Description                                                          *
+* ------------- -------     -- -----------------------------                                        *
+*   o           OCVModel       OCVModel object                                                      *
+*                                                                                                   *
+*                                                                                                   *
+* STATIC VARIABLES:                                                                                 *
+*                                                                                                   *
+*   Name     Type       I/O      Description                                                        *
+*   ----     ----       ---      -----------                                                        *
+*   none                                                                                            *
+*                                                                                                   *
+* EXTERNAL REFERENCES:                                                                              *
+*                                                                                                   *
+*  Name                       Description                                                           *
+*  -------------              -----------                                                           *
+*  none                                                                                             *
+*                                                                                                   *
+* ABNORMAL TERMINATION CONDITIONS, ERROR AND WARNING MESSAGES:                                      *
+*    pxOCVModelCreate fails if a grid of OvS has less than 2 points                                 *
+*                                                                                                   *
+* ASSUMPTIONS, CONSTRAINTS, RESTRICTIONS:                                                           *
+*    The SOC and OCV rows of OvS are increasing, then zero padded. Grids which are not              *
+*    uniform are resampled with their smallest step, up to OCV_MAX_POINTS points.                   *
+*    Outside of a grid the first or last bin is extrapolated, as the original tables were.          *
+*    The temperature grid of the surface is set by OCV_T_MIN, OCV_T_MAX and OCV_T_STEP.            *
+*    OCV_CHEB fits OCV0 and OCVrel at model load, dOCV0 and dOCVrel are then not used.              *
+*                                                                                                   *
+* NOTES: see documentations                                                                         *
+*                                                                                                   *
+* REQUIREMENTS/FUNCTIONAL SPECIFICATIONS REFERENCES:                                                *
+*                                                                                                   *
+* DEVELOPMENT HISTORY:                                                                              *
+*                                                                                                   *
+*   Date          Author            Change Id     Release     Description Of Change                 *
+*   ----          ------            ---------     ------      ----------------------                *
+*   17-10-2026    agent                            1          Project created                       *
+*   17-10-2026    agent                            2          OCV and dOCV baked on a bilinear      *
+*                                                              (T, SOC) surface                     *
+*   17-10-2026    agent                            3          Fused OCV and dOCV evaluator          *
+*   17-10-2026    agent                            4          Piecewise Chebyshev option            *
+*                                                                                                   *
+****************************************************************************************************/
+
+#include "../include/OCV_MODEL.h"
+
+/* Declare Prototypes */
+static int   iGridFromRow(OCVGrid*, const float*, int);
+static void  vResample(float*, const float*, const float*, int, const OCVGrid*);
+static void  vSlope(float*, const float*, const OCVGrid*);
+static int   iBin(const OCVGrid*, const float, float*);
+#if OCV_MODEL_KIND == OCV_CHEB
+static void  vFitCheb(OCVModel*, int, const float*);
+static void  vCheb(const OCVModel*, const float, const float, float*, float*);
+#else
+static void  vBakeSurface(OCVModel*, int, const float*, const float*);
+static float fSurface(const OCVModel*, int, const float, const float);
+#endif
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxOCVModelCreate                                               *
+*                                                                               *
+* PURPOSE: Creates the object OCVModel from the cell model tables:              *
+*           OCV0, OCVrel, dOCV0 and dOCVrel baked on the (T, SOC) surface,      *
+*           or OCV0 and OCVrel fitted by Chebyshev polynomials (OCV_CHEB),      *
+*           SOC0 and SOCrel resampled on the uniform OCV grid                   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* OvS       const Matrix* I      Matrix of OCV vs SOC, OvSLenght rows           *
+*                                                                               *
+* RETURN VALUE: OCVModel*                                                       *
+*               NULL if failed                                                  *
+*                                                                               *
+********************************************************************************/
+
+OCVModel* pxOCVModelCreate(const Matrix* OvS)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       ---------------
+     * o             OCVModel*     Created model
+     * rs            Matrix*       OCV0, OCVrel, dOCV0 and dOCVrel on the SOC grid
+     * n_soc         int           Points of the SOC row
+     * n_ocv         int           Points of the OCV row
+     */
+
+    OCVModel* o;
+    Matrix*   rs;
+    int       n_soc;
+    int       n_ocv;
+
+    if (OvS == NULL || OvS->r < OvSLenght)
+        return NULL;
+
+    o = (OCVModel*) malloc(sizeof(OCVModel));
+    if (o == NULL)
+    {
+        perror("Error Create");
+        return NULL;
+    }
+
+    n_soc = iGridFromRow(&o->soc, OvS->matrix[SOC], OvS->c);
+    n_ocv = iGridFromRow(&o->ocv, OvS->matrix[OCV], OvS->c);
+    if (n_soc < 2 || n_ocv < 2)
+    {
+        free(o);
+        return NULL;
+    }
+
+    o->temp.n     = (int)((OCV_T_MAX - OCV_T_MIN) / OCV_T_STEP + 0.5f) + 1;
+    o->temp.n     = (o->temp.n < 2) ? 2 : o->temp.n;
+    o->temp.x0    = OCV_T_MIN;
+    o->temp.h     = OCV_T_STEP;
+    o->temp.h_inv = 1 / o->temp.h;
+
+    o->tab  = pxCreate(O_ROWS, o->ocv.n);
+    rs      = pxCreate(4, o->soc.n);
+#if OCV_MODEL_KIND == OCV_CHEB
+    o->seg.n     = OCV_CHEB_SEGS + 1;
+    o->seg.x0    = o->soc.x0;
+    o->seg.h     = (o->soc.n - 1) * o->soc.h / OCV_CHEB_SEGS;
+    o->seg.h_inv = 1 / o->seg.h;
+    o->surf      = NULL;
+    o->cheb      = pxCreate(OCV_CHEB_SEGS, C_SIZE);
+#else
+    o->surf = pxCreate(o->temp.n - 1, (o->soc.n - 1) * P_SIZE);
+    o->cheb = NULL;
+#endif
+    if (o->tab == NULL || (o->surf == NULL && o->cheb == NULL) || rs == NULL)
+    {
+        vDestroy(o->tab);
+        vDestroy(o->surf);
+        vDestroy(o->cheb);
+        vDestroy(rs);
+        free(o);
+        return NULL;
+    }
+
+    vResample(o->tab->matrix[O_SOC0],   OvS->matrix[OCV], OvS->matrix[SOC0],   n_ocv, &o->ocv);
+    vResample(o->tab->matrix[O_SOCREL], OvS->matrix[OCV], OvS->matrix[SOCrel], n_ocv, &o->ocv);
+    vSlope(o->tab->matrix[O_SSOC0],   o->tab->matrix[O_SOC0],   &o->ocv);
+    vSlope(o->tab->matrix[O_SSOCREL], o->tab->matrix[O_SOCREL], &o->ocv);
+
+    vResample(rs->matrix[0], OvS->matrix[SOC], OvS->matrix[OCV0],    n_soc, &o->soc);
+    vResample(rs->matrix[1], OvS->matrix[SOC], OvS->matrix[OCVrel],  n_soc, &o->soc);
+    vResample(rs->matrix[2], OvS->matrix[SOC], OvS->matrix[dOCV0],   n_soc, &o->soc);
+    vResample(rs->matrix[3], OvS->matrix[SOC], OvS->matrix[dOCVrel], n_soc, &o->soc);
+#if OCV_MODEL_KIND == OCV_CHEB
+    vFitCheb(o, C_OCV0,   rs->matrix[0]);
+    vFitCheb(o, C_OCVREL, rs->matrix[1]);
+#else
+    vBakeSurface(o, P_OCV,  rs->matrix[0], rs->matrix[1]);
+    vBakeSurface(o, P_DOCV, rs->matrix[2], rs->matrix[3]);
+#endif
+
+    vDestroy(rs);
+
+    return o;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iGridFromRow                                                   *
+*                                                                               *
+* PURPOSE: Counts the increasing points of a row of OvS and sets the uniform    *
+*           grid spanning them with their smallest step, which is the grid      *
+*           itself when the row is already uniform                              *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* g         OCVGrid*      O      Uniform grid                                   *
+* x         const float*  I      Row of OvS                                     *
+* c         int           I      Columns of OvS                                 *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*               number of points of the row                                     *
+*                                                                               *
+********************************************************************************/
+
+static int iGridFromRow(OCVGrid* g, const float* x, int c)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * n             int       Points of the row
+     * h             float     Smallest step
+     */
+
+    int   n = 1;
+    float h;
+
+    while (n < c && x[n] > x[n - 1])
+        n++;
+    if (n < 2)
+        return n;
+
+    h = x[1] - x[0];
+    for (int j = 2; j < n; j++)
+    {
+        if (x[j] - x[j - 1] < h)
+            h = x[j] - x[j - 1];
+    }
+
+    /* Same number of points when the row is uniform, up to rounding */
+    g->n = (int)((x[n - 1] - x[0]) / h + 0.5f) + 1;
+    if (g->n > OCV_MAX_POINTS)
+        g->n = OCV_MAX_POINTS;
+    if (g->n < n && g->n < OCV_MAX_POINTS)
+        g->n = n;
+
+    g->x0    = x[0];
+    g->h     = (x[n - 1] - x[0]) / (g->n - 1);
+    g->h_inv = 1 / g->h;
+
+    return n;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vResample                                                      *
+*                                                                               *
+* PURPOSE: Resamples y(x) on the grid g, by linear interpolation.               *
+*           The bin is searched here, at load time only                         *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* v         float*         O      Values at the points of g                     *
+* x         const float*   I      Points of the original table                  *
+* y         const float*   I      Values of the original table                  *
+* n         int            I      Points of the original table                  *
+* g         const OCVGrid* I      Uniform grid                                  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vResample(float* v, const float* x, const float* y, int n, const OCVGrid* g)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * i             int       Bin of the original table
+     * j             int       Loop counter
+     */
+
+    int i = 0;
+    int j;
+
+    for (j = 0; j < g->n; j++)
+    {
+        const float p = (j == g->n - 1) ? x[n - 1] : g->x0 + j * g->h;
+
+        while (i < n - 2 && x[i + 1] < p)
+            i++;
+        v[j] = y[i] + (p - x[i]) * (y[i + 1] - y[i]) / (x[i + 1] - x[i]);
+    }
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSlope                                                         *
+*                                                                               *
+* PURPOSE: Computes the slope of v in each bin of the grid g,                   *
+*           the last point repeating the last bin                               *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* s         float*         O      Slopes                                        *
+* v         const float*   I      Values at the points of g                     *
+* g         const OCVGrid* I      Uniform grid                                  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vSlope(float* s, const float* v, const OCVGrid* g)
+{
+    for (int j = 0; j < g->n - 1; j++)
+        s[j] = (v[j + 1] - v[j]) * g->h_inv;
+
+    s[g->n - 1] = s[g->n - 2];
+}
+
+#if OCV_MODEL_KIND == OCV_SURFACE
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBakeSurface                                                   *
+*                                                                               *
+* PURPOSE: Bakes f(T, SOC) = f0(SOC) + T*frel(SOC) on the patches of the        *
+*           surface, as the bilinear coefficients of each patch.                *
+*           Computed in double, the differences of close values included        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* o         OCVModel*     IO     OCVModel structure                             *
+* off       int           I      P_OCV or P_DOCV                                *
+* f0        const float*  I      f0 on the SOC grid                             *
+* frel      const float*  I      frel on the SOC grid                           *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vBakeSurface(OCVModel* o, int off, const float* f0, const float* frel)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * t             int       Temperature bin
+     * j             int       SOC bin
+     * T0, T1        double    Temperatures of the bin
+     * f00 .. f11    double    f at the corners of the patch, (T, SOC)
+     * p             float*    Coefficients of the patch
+     */
+
+    int     t;
+    int     j;
+
+    for (t = 0; t < o->temp.n - 1; t++)
+    {
+        const double T0 = o->temp.x0 + (double)t * o->temp.h;
+        const double T1 = T0 + o->temp.h;
+
+        for (j = 0; j < o->soc.n - 1; j++)
+        {
+            const double f00 = f0[j]     + T0 * frel[j];
+            const double f01 = f0[j + 1] + T0 * frel[j + 1];
+            const double f10 = f0[j]     + T1 * frel[j];
+            const double f11 = f0[j + 1] + T1 * frel[j + 1];
+            float*       p   = &MAT(o->surf, t, (size_t)j * P_SIZE + off);
+
+            p[0] = f00;
+            p[1] = (f01 - f00) * o->soc.h_inv;
+            p[2] = (f10 - f00) * o->temp.h_inv;
+            p[3] = (f11 - f10 - f01 + f00) * o->soc.h_inv * o->temp.h_inv;
+        }
+    }
+
+}
+
+#endif
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iBin                                                           *
+*                                                                               *
+* PURPOSE: Computes the bin of x on the uniform grid g, clamped to the first    *
+*           or last one, which are then extrapolated, and the offset of x       *
+*           from the first point of the bin                                     *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* g         const OCVGrid* I      Uniform grid                                  *
+* x         const float    I      Point                                         *
+* d         float*         O      Offset of x in the bin                        *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*               bin of x                                                        *
+*                                                                               *
+********************************************************************************/
+
+static inline int iBin(const OCVGrid* g, const float x, float* d)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * t             float     Position of x on the grid, in steps
+     * j             int       Bin of x
+     */
+
+    float t = (x - g->x0) * g->h_inv;
+    int   j;
+
+    /* Also maps NaN to the first bin */
+    t = (t >= 0) ? t : 0;
+    t = (t <= g->n - 2) ? t : g->n - 2;
+    j = (int)t;
+
+    *d = x - (g->x0 + j * g->h);
+
+    return j;
+}
+
+#if OCV_MODEL_KIND == OCV_SURFACE
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fSurface                                                       *
+*                                                                               *
+* PURPOSE: Evaluates OCV or dOCV at (T, SOC) on its patch of the surface:       *
+*           f + u*f_s + w*(f_t + u*f_st)                                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* o         const OCVModel* I      OCVModel structure                           *
+* off       int             I      P_OCV or P_DOCV                              *
+* soc       const float     I      SOC                                          *
+* T         const float     I      Temperature of the cell                      *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+
+static inline float fSurface(const OCVModel* o, int off, const float soc, const float T)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       ---------------
+     * u             float         Offset of soc in its bin
+     * w             float         Offset of T in its bin
+     * p             const float*  Coefficients of the patch
+     */
+
+    float        u;
+    float        w;
+    const int    j = iBin(&o->soc, soc, &u);
+    const int    t = iBin(&o->temp, T, &w);
+    const float* p = &MAT(o->surf, t, (size_t)j * P_SIZE + off);
+
+    return p[0] + u * p[1] + w * (p[2] + u * p[3]);
+}
+
+#else
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vFitCheb                                                       *
+*                                                                               *
+* PURPOSE: Fits v(SOC), linearly interpolated on the SOC grid, in each          *
+*           segment by a Chebyshev series of degree OCV_CHEB_DEG, least         *
+*           squares on OCV_CHEB_NODES Chebyshev nodes, then stores it as        *
+*           the coefficients of the powers of x in [-1, 1], for Horner          *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* o         OCVModel*     IO     OCVModel structure                             *
+* col       int           I      C_OCV0 or C_OCVREL                             *
+* v         const float*  I      Values on the SOC grid                         *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vFitCheb(OCVModel* o, int col, const float* v)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       ---------------
+     * c             double[]      Chebyshev coefficients of the segment
+     * t0, t1, t2    double[]      Powers of x of T_k-1, T_k and T_k+1
+     * pi            double        Pi
+     */
+
+    double       c[OCV_CHEB_DEG + 1];
+    double       t0[OCV_CHEB_DEG + 1];
+    double       t1[OCV_CHEB_DEG + 1];
+    double       t2[OCV_CHEB_DEG + 1];
+    const double pi = acos(-1.0);
+    int          s;
+    int          m;
+    int          k;
+    int          i;
+
+    for (s = 0; s < OCV_CHEB_SEGS; s++)
+    {
+        float* row = &o->cheb->matrix[s][col];
+
+        /* T_k(cos(th)) = cos(k*th), orthogonal on the nodes */
+        memset(c, 0, sizeof(c));
+        for (m = 0; m < OCV_CHEB_NODES; m++)
+        {
+            const double th = pi * (m + 0.5) / OCV_CHEB_NODES;
+            const float  z  = o->seg.x0 + (s + 0.5f + 0.5f * (float)cos(th)) * o->seg.h;
+            float        d;
+            const int    j  = iBin(&o->soc, z, &d);
+            const double f  = v[j] + d * (v[j + 1] - v[j]) * o->soc.h_inv;
+
+            for (k = 0; k <= OCV_CHEB_DEG; k++)
+                c[k] += f * cos(k * th);
+        }
+        for (k = 0; k <= OCV_CHEB_DEG; k++)
+            c[k] *= 2.0 / OCV_CHEB_NODES;
+        c[0] *= 0.5;
+
+        /* Powers of x, by T_k+1 = 2x*T_k - T_k-1 */
+        memset(t0, 0, sizeof(t0));
+        memset(t1, 0, sizeof(t1));
+        t0[0] = 1;
+        if (OCV_CHEB_DEG > 0)
+            t1[1] = 1;
+
+        for (i = 0; i <= OCV_CHEB_DEG; i++)
+            row[i] = c[0] * t0[i] + ((OCV_CHEB_DEG > 0) ? c[1] * t1[i] : 0);
+
+        for (k = 2; k <= OCV_CHEB_DEG; k++)
+        {
+            for (i = 0; i <= OCV_CHEB_DEG; i++)
+                t2[i] = ((i > 0) ? 2 * t1[i - 1] : 0) - t0[i];
+            for (i = 0; i <= OCV_CHEB_DEG; i++)
+            {
+                row[i] += c[k] * t2[i];
+                t0[i]   = t1[i];
+                t1[i]   = t2[i];
+            }
+        }
+    }
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vCheb                                                          *
+*                                                                               *
+* PURPOSE: Evaluates OCV and dOCV at (T, SOC) on the segment of SOC by          *
+*           Horner's scheme, the derivative in the same pass. Out of the        *
+*           grid the first or last segment is extrapolated linearly             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* o         const OCVModel* I      OCVModel structure                           *
+* soc       const float     I      SOC                                          *
+* T         const float     I      Temperature of the cell                      *
+* ocv       float*          O      OCV                                          *
+* docv      float*          O      dOCV                                         *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static inline void vCheb(const OCVModel* o, const float soc, const float T, float* ocv, float* docv)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       ---------------
+     * x             float         soc mapped on [-1, 1] of its segment
+     * xc            float         x clamped to [-1, 1]
+     * c             const float*  Coefficients of the segment
+     * p, q          float         OCV0 and OCVrel at xc
+     * dp, dq        float         Their derivatives in x
+     */
+
+    float        x;
+    const int    s  = iBin(&o->seg, soc, &x);
+    const float* c  = o->cheb->matrix[s];
+    float        xc;
+    float        p  = c[C_OCV0 + OCV_CHEB_DEG];
+    float        q  = c[C_OCVREL + OCV_CHEB_DEG];
+    float        dp = 0;
+    float        dq = 0;
+
+    x  = 2 * x * o->seg.h_inv - 1;
+    xc = (x >= -1) ? x : -1;
+    xc = (xc <= 1) ? xc : 1;
+
+    for (int k = OCV_CHEB_DEG - 1; k >= 0; k--)
+    {
+        dp = dp * xc + p;
+        dq = dq * xc + q;
+        p  = p * xc + c[C_OCV0 + k];
+        q  = q * xc + c[C_OCVREL + k];
+    }
+
+    *ocv  = (p + T * q) + (x - xc) * (dp + T * dq);
+    *docv = (dp + T * dq) * 2 * o->seg.h_inv;
+}
+#endif
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fOCVfromSOC                                                    *
+*                                                                               *
+* PURPOSE: Computing Open Circuit Voltage starting from State of Charge         *
+*      OCV(z,t)=OCV0(z)+T*OCVrel(z), from the surface                           *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* soc       const float     I      SOC at time t                                *
+* T         const float     I      Temperature of the cell                      *
+* o         const OCVModel* I      OCVModel structure                           *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*             being cell's OCV                                                  *
+*                                                                               *
+********************************************************************************/
+
+float fOCVfromSOC(const float soc, const float T, const OCVModel* o)
+{
+#if OCV_MODEL_KIND == OCV_CHEB
+    float ocv;
+    float docv;
+
+    vCheb(o, soc, T, &ocv, &docv);
+    return ocv;
+#else
+    return fSurface(o, P_OCV, soc, T);
+#endif
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fDOCVfromSOC                                                   *
+*                                                                               *
+* PURPOSE: Computing derivative of Open Circuit Voltage                         *
+*           starting from State of Charge                                       *
+*      dOCV(z,t)=dOCV0(z)+T*dOCVrel(z), from the surface                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* soc       const float     I      SOC at time t                                *
+* T         const float     I      Temperature of the cell                      *
+* o         const OCVModel* I      OCVModel structure                           *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*             being cell's dOCV                                                 *
+*                                                                               *
+********************************************************************************/
+
+float fDOCVfromSOC(const float soc, const float T, const OCVModel* o)
+{
+#if OCV_MODEL_KIND == OCV_CHEB
+    float ocv;
+    float docv;
+
+    vCheb(o, soc, T, &ocv, &docv);
+    return docv;
+#else
+    return fSurface(o, P_DOCV, soc, T);
+#endif
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fSOCfromOCV                                                    *
+*                                                                               *
+* PURPOSE: Computing State of Charge starting from Open Circuit Voltage         *
+*      SOC(z,t)=SOC0(z)+T*SOCrel(z)                                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* ocv       const float     I      OCV at time t                                *
+* T         const float     I      Temperature of the cell                      *
+* o         const OCVModel* I      OCVModel structure                           *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*             being cell's SOC                                                  *
+*                                                                               *
+********************************************************************************/
+
+float fSOCfromOCV(const float ocv, const float T, const OCVModel* o)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * d             float     Offset of ocv in its bin
+     * j             int       Bin of ocv
+     * r             float**   Rows of the table
+     */
+
+    float   d;
+    int     j = iBin(&o->ocv, ocv, &d);
+    float** r = o->tab->matrix;
+
+    return (r[O_SOC0][j] + T * r[O_SOCREL][j]) + d * (r[O_SSOC0][j] + T * r[O_SSOCREL][j]);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vOCVfromSOCBatch                                               *
+*                                                                               *
+* PURPOSE: Computing Open Circuit Voltage of n cells, each at its own           *
+*           temperature. Branch free, one patch or segment read per cell,       *
+*           so that the loop can be vectorized                                  *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* o         const OCVModel* I      OCVModel structure                           *
+* soc       const float*    I      SOC of the cells                             *
+* T         const float*    I      Temperature of the cells                     *
+* ocv       float*          O      OCV of the cells                             *
+* n         size_t          I      Number of cells                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vOCVfromSOCBatch(const OCVModel* o, const float* soc, const float* T, float* ocv, size_t n)
+{
+    for (size_t c = 0; c < n; c++)
+        ocv[c] = fOCVfromSOC(soc[c], T[c], o);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vDOCVfromSOCBatch                                              *
+*                                                                               *
+* PURPOSE: Computing derivative of Open Circuit Voltage of n cells,             *
+*           each at its own temperature, as vOCVfromSOCBatch                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* o         const OCVModel* I      OCVModel structure                           *
+* soc       const float*    I      SOC of the cells                             *
+* T         const float*    I      Temperature of the cells                     *
+* docv      float*          O      dOCV of the cells                            *
+* n         size_t          I      Number of cells                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vDOCVfromSOCBatch(const OCVModel* o, const float* soc, const float* T, float* docv, size_t n)
+{
+    for (size_t c = 0; c < n; c++)
+        docv[c] = fDOCVfromSOC(soc[c], T[c], o);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vOCVdOCVfromSOCBatch                                           *
+*                                                                               *
+* PURPOSE: Computing Open Circuit Voltage and its derivative of n cells,        *
+*           each at its own temperature. The bin of each cell is computed       *
+*           once and both come from the same patch                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type            IO     Description                                  *
+* --------- --------        --     ---------------------------------            *
+* o         const OCVModel* I      OCVModel structure                           *
+* soc       const float*    I      SOC of the cells                             *
+* T         const float*    I      Temperature of the cells                     *
+* ocv       float*          O      OCV of the cells                             *
+* docv      float*          O      dOCV of the cells                            *
+* n         size_t          I      Number of cells                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vOCVdOCVfromSOCBatch(const OCVModel* o, const float* soc, const float* T, float* ocv, float* docv, size_t n)
+{
+#if OCV_MODEL_KIND == OCV_CHEB
+    for (size_t c = 0; c < n; c++)
+        vCheb(o, soc[c], T[c], &ocv[c], &docv[c]);
+#else
+    for (size_t c = 0; c < n; c++)
+    {
+        float        u;
+        float        w;
+        const int    j = iBin(&o->soc, soc[c], &u);
+        const int    t = iBin(&o->temp, T[c], &w);
+        const float* p = &MAT(o->surf, t, (size_t)j * P_SIZE);
+
+        ocv[c]  = p[P_OCV] + u * p[P_OCV_S] + w * (p[P_OCV_T] + u * p[P_OCV_ST]);
+        docv[c] = p[P_DOCV] + u * p[P_DOCV_S] + w * (p[P_DOCV_T] + u * p[P_DOCV_ST]);
+    }
+#endif
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vOCVModelDelete                                                *
+*                                                                               *
+* PURPOSE: This function destroys the object OCVModel                           *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* o         OCVModel*    IO     OCVModel structure                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vOCVModelDelete(OCVModel* o)
+{
+    if (o != NULL)
+    {
+        vDestroy(o->tab);
+        vDestroy(o->surf);
+        vDestroy(o->cheb);
+        free(o);
+    }
+}
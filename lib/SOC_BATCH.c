@@ -0,0 +1,456 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/****************************************************************************************************
+* FILE NAME: SOC_BATCH.c                                                                            *
+*                                                                                                   *
+* PURPOSE: This library implements the batch EKF, the per-cell EKF run on many cells                *
+*           stored as structure of arrays, with AVX2, SSE and scalar kernels                        *
+*                                                                                                   *
+* FILE REFERENCES:                                                                                  *
+*                                                                                                   *
+*   Name                I/O     Description                                                         *
+*   ----                ---     -----------                                                         *
+*   SOC_BATCH_kernel.h  I       Kernels, instantiated once per instruction set                      *
+*                                                                                                   *
+*                                                                                                   *
+* EXTERNAL VARIABLES:                                                                               *
+*                                                                                                   *
+* Source: <SOC_BATCH.h>                                                                             *
+*                                                                                                   *
+* Name          Type        IO Description                                                          *
+* ------------- -------     -- -----------------------------                                        *
+*   b           KalmanBatch    KalmanBatch object                                                   *
+*                                                                                                   *
+*                                                                                                   *
+* STATIC VARIABLES:                                                                                 *
+*                                                                                                   *
+*   Name     Type       I/O      Description                                                        *
+*   ----     ----       ---      -----------                                                        *
+*   none                                                                                            *
+*                                                                                                   *
+* EXTERNAL REFERENCES:                                                                              *
+*                                                                                                   *
+*  Name                       Description                                                           *
+*  -------------              -----------                                                           *
+*  vParamCacheUpdate          Parameters at temperature T, from SOC_EKF.c                           *
+*  vParamCacheStep            Constants of the step dt, from SOC_EKF.c                              *
+*  fSOCfromOCV                Initial SOC, from OCV_MODEL.c                                         *
+*                                                                                                   *
+* ABNORMAL TERMINATION CONDITIONS, ERROR AND WARNING MESSAGES:                                      *
+*    iBatchSetup fails if the model has no OCVModel                                                 *
+*                                                                                                   *
+* ASSUMPTIONS, CONSTRAINTS, RESTRICTIONS:                                                           *
+*    GCC vector extensions, the kernels are compiled for every instruction set                      *
+*    and chosen at run time. Every cell uses the same temperature.                                  *
+*                                                                                                   *
+* NOTES: see documentations                                                                         *
+*                                                                                                   *
+* REQUIREMENTS/FUNCTIONAL SPECIFICATIONS REFERENCES:                                                *
+*                                                                                                   *
+* DEVELOPMENT HISTORY:                                                                              *
+*                                                                                                   *
+*   Date          Author            Change Id     Release     Description Of Change                 *
+*   ----          ------            ---------     ------      ----------------------                *
+*   17-10-2026    agent                            1          Project created                       *
+*   17-10-2026    agent                            2          Grid and tables from the OCVModel     *
+*   17-10-2026    agent                            3          Lookup baked from the OCV surface     *
+*   17-10-2026    agent                            4          dOCV kept from predict to update      *
+*   17-10-2026    agent                            5          Parameters from a ParamCache          *
+*   17-10-2026    agent                            6          Measured step dt                      *
+*                                                                                                   *
+****************************************************************************************************/
+
+#include "../include/SOC_BATCH.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86   1
+#else
+#define BATCH_X86   0
+#endif
+
+/* Declare Prototypes */
+static void vBuildLookup(KalmanBatch*, const float);
+
+/* Kernels */
+#define BK_W        1
+#define BK_SUFFIX   _scalar
+#define BK_ATTR
+#include "../include/SOC_BATCH_kernel.h"
+#undef BK_W
+#undef BK_SUFFIX
+#undef BK_ATTR
+
+#if BATCH_X86
+
+#define BK_W        4
+#define BK_SUFFIX   _sse
+#define BK_ATTR     __attribute__((target("sse2")))
+#include "../include/SOC_BATCH_kernel.h"
+#undef BK_W
+#undef BK_SUFFIX
+#undef BK_ATTR
+
+#define BK_W        8
+#define BK_SUFFIX   _avx2
+#define BK_ATTR     __attribute__((target("avx2")))
+#include "../include/SOC_BATCH_kernel.h"
+#undef BK_W
+#undef BK_SUFFIX
+#undef BK_ATTR
+
+#endif
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iBatchSetup                                                    *
+*                                                                               *
+* PURPOSE: Creates the KalmanBatch and initializes the cells,                   *
+*           as vSetup. The batch uses the cell model tables of model,           *
+*           that must be deleted after the batch                                *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* b         KalmanBatch*   O      KalmanBatch structure                         *
+* model     const Kalman*  I      Kalman owning Ocv and Param, after vSetup     *
+* n         size_t         I      Number of cells                               *
+* T         const float    I      Temperature at time 0                         *
+* v_0       const float*   I      Voltage of the cells at time 0                *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*               0 on success, -1 if the model has no OCVModel                   *
+*                                                                               *
+********************************************************************************/
+
+int iBatchSetup(KalmanBatch* b, const Kalman* model, size_t n, const float T, const float* v_0)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type           Description
+     * ------------- -------        ---------------
+     * c             size_t         Loop counter
+     */
+
+    size_t c;
+
+    if (model->Ocv == NULL)
+        return -1;
+
+    b->Ocv   = model->Ocv;
+    b->Param = model->Param;
+    b->n     = n;
+    b->Par.T    = NAN;
+    b->dt_carry = 0;
+
+    b->soc0  = b->Ocv->soc.x0;
+    b->h     = b->Ocv->soc.h;
+    b->h_inv = b->Ocv->soc.h_inv;
+    b->n_soc = b->Ocv->soc.n;
+
+    /* Rows padded to a multiple of 8 cells, so that every row is MATRIX_ALIGN aligned */
+    b->st  = pxCreate(B_ROWS, (n + 7) & ~(size_t)7);
+    b->lut = pxCreate(L_ROWS, b->n_soc);
+
+    vBuildLookup(b, fParamBucket(T));
+
+    for (c = 0; c < n; c++)
+    {
+        b->st->matrix[B_XZ][c]  = fSOCfromOCV(v_0[c], T, b->Ocv);
+        b->st->matrix[B_P00][c] = 100;
+        b->st->matrix[B_P11][c] = 0.01;
+        b->st->matrix[B_P22][c] = 0.001;
+        b->st->matrix[B_Q][c]   = 4;
+        b->st->matrix[B_R][c]   = 0.3;
+        b->st->matrix[B_H2][c]  = fDOCVfromSOC(b->st->matrix[B_XZ][c], b->lut_T, b->Ocv);
+    }
+
+#if BATCH_X86
+    if (iBatchSetISA(b, BATCH_AVX2) && iBatchSetISA(b, BATCH_SSE))
+#endif
+        iBatchSetISA(b, BATCH_SCALAR);
+
+    return 0;
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iBatchSetISA                                                   *
+*                                                                               *
+* PURPOSE: Selects the kernels of the batch. iBatchSetup already selects        *
+*           the widest one supported by the CPU, all of them giving             *
+*           the same results                                                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* isa       int           I      BATCH_SCALAR, BATCH_SSE or BATCH_AVX2          *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*               0 on success, -1 if the CPU does not support isa                *
+*                                                                               *
+********************************************************************************/
+
+int iBatchSetISA(KalmanBatch* b, int isa)
+{
+
+    b->predict_tail = vBatchPredict_scalar;
+    b->update_tail  = vBatchUpdate_scalar;
+
+    switch (isa)
+    {
+    case BATCH_SCALAR:
+        b->predict = vBatchPredict_scalar;
+        b->update  = vBatchUpdate_scalar;
+        b->width   = 1;
+        break;
+
+#if BATCH_X86
+    case BATCH_SSE:
+        if (!__builtin_cpu_supports("sse2"))
+            return -1;
+        b->predict = vBatchPredict_sse;
+        b->update  = vBatchUpdate_sse;
+        b->width   = 4;
+        break;
+
+    case BATCH_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+            return -1;
+        b->predict = vBatchPredict_avx2;
+        b->update  = vBatchUpdate_avx2;
+        b->width   = 8;
+        break;
+#endif
+
+    default:
+        return -1;
+    }
+
+    b->isa = isa;
+
+    return 0;
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBatchStep1                                                    *
+*                                                                               *
+* PURPOSE: Prediction step of the EKF on all the cells (Kalman Filter Step 1)   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* u         const float*  I      Current of the cells at time t, n values       *
+* T         const float   I      Temperature at time t                          *
+* dt        const float   I      Time since the previous step in s, measured    *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vBatchStep1(KalmanBatch* b, const float* u, const float T, const float dt)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * split         size_t    First cell of the scalar tail
+     */
+
+    size_t split = b->n - b->n % b->width;
+
+    vParamCacheUpdate(&b->Par, T, b->Param);
+    vParamCacheStep(&b->Par, fStepDt(&b->dt_carry, dt));
+
+    /* The table follows the bucket of T, as the parameters do */
+    if (b->Par.T != b->lut_T)
+        vBuildLookup(b, b->Par.T);
+
+    b->predict(b, u, 0, split);
+    b->predict_tail(b, u, split, b->n);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBatchStep2                                                    *
+*                                                                               *
+* PURPOSE: Update step of the EKF on all the cells (Kalman Filter Step 2)       *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* y         const float*  I      Voltage of the cells at time t, n values       *
+* T         const float   I      Temperature at time t                          *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vBatchStep2(KalmanBatch* b, const float* y, const float T)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * split         size_t    First cell of the scalar tail
+     * t             float     Center of the bucket of T
+     */
+
+    size_t split = b->n - b->n % b->width;
+    float  t     = fParamBucket(T);
+
+    /* dOCV at the predicted SOC comes from the predict kernel, again only if the bucket of T changed since */
+    if (t != b->lut_T)
+    {
+        vBuildLookup(b, t);
+
+        for (size_t c = 0; c < b->n; c++)
+            b->st->matrix[B_H2][c] = fDOCVfromSOC(b->st->matrix[B_XZ][c], t, b->Ocv);
+    }
+
+    b->update(b, y, 0, split);
+    b->update_tail(b, y, split, b->n);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fBatchGetSOC                                                   *
+*                                                                               *
+* PURPOSE: Returns the estimated SOC of a cell                                  *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type                IO     Description                              *
+* --------- --------            --     ---------------------------------        *
+* b         const KalmanBatch*  I      KalmanBatch structure                    *
+* c         size_t              I      Index of the cell, 0 <= c < n            *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+
+float fBatchGetSOC(const KalmanBatch* b, size_t c)
+{
+    return b->st->matrix[B_XZ][c];
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fBatchGetSOCVar                                                *
+*                                                                               *
+* PURPOSE: Returns the variance of the SOC estimate of a cell                   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type                IO     Description                              *
+* --------- --------            --     ---------------------------------        *
+* b         const KalmanBatch*  I      KalmanBatch structure                    *
+* c         size_t              I      Index of the cell, 0 <= c < n            *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+
+float fBatchGetSOCVar(const KalmanBatch* b, size_t c)
+{
+    return b->st->matrix[B_P22][c];
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBuildLookup                                                   *
+*                                                                               *
+* PURPOSE: Computes OCV(SOC) and dOCV(SOC) at temperature T on the              *
+*           uniform SOC grid, with the slope of each bin, so that the           *
+*           kernels read one table instead of the OCVModel surface              *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+* T         const float   I      Temperature                                    *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vBuildLookup(KalmanBatch* b, const float T)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   ---------------
+     * j             int       Loop counter
+     * l             float**   Rows of the lookup table
+     */
+
+    int     j;
+    float** l = b->lut->matrix;
+
+    for (j = 0; j < b->n_soc; j++)
+    {
+        l[L_OCV][j]  = fOCVfromSOC(b->soc0 + j * b->h, T, b->Ocv);
+        l[L_DOCV][j] = fDOCVfromSOC(b->soc0 + j * b->h, T, b->Ocv);
+    }
+
+    for (j = 0; j < b->n_soc - 1; j++)
+    {
+        l[L_SOCV][j]  = (l[L_OCV][j + 1] - l[L_OCV][j]) * b->h_inv;
+        l[L_SDOCV][j] = (l[L_DOCV][j + 1] - l[L_DOCV][j]) * b->h_inv;
+    }
+
+    b->lut_T = T;
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBatchDelete                                                   *
+*                                                                               *
+* PURPOSE: This function destroys the object KalmanBatch                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* b         KalmanBatch*  IO     KalmanBatch structure                          *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vBatchDelete(KalmanBatch* b)
+{
+    vDestroy(b->st);
+    vDestroy(b->lut);
+    b->st  = NULL;
+    b->lut = NULL;
+}
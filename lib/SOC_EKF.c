@@ -70,6 +70,42 @@
 *                  Giardino																		    *
 *   28-12-2020    N.di Gruttola                    1          V1 Created					        *
 *                  Giardino																		    *
+*   17-10-2026    agent                            2          Steps use the KalmanWorkspace, no     *
+*                                                              malloc/free after vSetup             *
+*   17-10-2026    agent                            3          Reentrant: no static state, the       *
+*                                                              model tables can be shared           *
+*   17-10-2026    agent                            4          Per-cell engine (EKF_PERCELL)         *
+*   17-10-2026    agent                            5          vGetParam and fSOCfromOCV exported    *
+*                                                              for the batch engine                 *
+*   17-10-2026    agent                            6          Kalman gain by Cholesky solve         *
+*   17-10-2026    agent                            7          Step 1b by iCovPropagate              *
+*   17-10-2026    agent                            8          Steps by iGemm, no transposes         *
+*   17-10-2026    agent                            9          Pk, Sk and Rk packed symmetric,       *
+*                                                              Kk stored transposed                 *
+*   17-10-2026    agent                            10         Fk, D diagonal, Gk, Hk sparse, Pc     *
+*                                                              block diagonal                       *
+*   17-10-2026    agent                            11         OCV lookups moved in OCV_MODEL.c      *
+*   17-10-2026    agent                            12         OCV and dOCV evaluated once per step  *
+*   17-10-2026    agent                            13         Parameters interpolated in T, cached  *
+*                                                              with their constants (ParamCache)    *
+*   17-10-2026    agent                            14         Temperature of each cell, parameters  *
+*                                                              once per bucket (vGetParamBatch)     *
+*   17-10-2026    agent                            15         Measured step dt, decays cached per   *
+*                                                              rounded dt (fStepDt)                 *
+*   17-10-2026    agent                            16         Output prediction moved to Step2,     *
+*                                                              any number of Step1 per Step2        *
+*   17-10-2026    agent                            17         Sequential scalar update of the       *
+*                                                              outputs (EKF_UPD_SEQ)                *
+*   17-10-2026    agent                            18         Parallel groups lumped in one cell    *
+*                                                              (EKF_LUMP_PAR)                       *
+*   17-10-2026    agent                            19         Gain scheduling of the per-cell       *
+*                                                              engine (EKF_GAIN_SCHED)              *
+*   17-10-2026    agent                            20         Rest fast path, deferred covariance   *
+*                                                              steps (EKF_REST)                     *
+*   17-10-2026    agent                            21         Rk and Qk estimated on a window of    *
+*                                                              innovations (EKF_ADAPT)              *
+*   17-10-2026    agent                            22         SOC steps scaled by the estimated     *
+*                                                              capacity (EKF_SOH)                   *
 *                                                                                                   *
 *                                                                                                   *
 *                                                                                                   *
@@ -79,25 +115,26 @@
 
 #include "../include/SOC_EKF.h"
 
-/* Declare Static Variables */
-
-static float           i_prev[U_SIZE];
-static int             i_sign[U_SIZE];
-static Matrix*         int_Gku;                         /* Used to compute G*u */                   
-static float           Parameters[PARAM_SIZE - 1];     /* Parameters at time t */
-static Matrix*         app;                         /* Used as a support variable */
-static Matrix*         app2;                        /* Used as a support variable */
-static Matrix*         app3;                        /* Used as a support variable */
-static Matrix*         app4;                        /* Used as a support variable */
-static Matrix*         t1;                          /* Used as a support variable */
-static Matrix*         t2;                          /* Used as a support variable */
-
 /* Declare Static Function's Prototypes */
 
-static void  vGetParam(float*, const float, const Matrix*);
-static float fSOCfromOCV(const float, const float, const Matrix*);
-static float fOCVfromSOC(const float, const float, const Matrix*);
-static float fDOCVfromSOC(const float, const float, const Matrix*);
+#if EKF_ENGINE == EKF_DENSE
+static void  vCreateWorkspace(KalmanWorkspace*);
+static void  vDestroyWorkspace(KalmanWorkspace*);
+#endif
+static void  vCellModel(const Kalman*, size_t, float*, float*, float*);
+#if EKF_GAIN_SCHED
+static int   iGainBin(const float, const float, const int);
+static void  vGainLearn(Kalman*, size_t, int, const float*, const float, const float*);
+#endif
+#if EKF_REST
+static int   iAtRest(const Kalman*, size_t);
+static int   iRestSkip(const Kalman*, size_t, const float);
+static void  vRestDefer(Kalman*, size_t);
+static void  vRestFlush(Kalman*, size_t);
+#endif
+#if EKF_ADAPT != ADAPT_OFF
+static void  vAdaptNoise(Kalman*, size_t, const float, const float, const float*);
+#endif
 
 /********************************************************************************
 *                                                                               *
@@ -115,62 +152,200 @@ static float fDOCVfromSOC(const float, const float, const Matrix*);
 * k         Kalman*      IO     Kalman structure, contains                      *
 *                                all matrices needed for the execution of       *
 *                                the algorithm                                  *
-* T         const float  I      Temperature of the cell                         *
+* T         const float* I      Temperature of the cells, N_CELLS values        *
 * v_0       float        I      Voltage of the cell at T-0                      *
+* owner     const Kalman* I     NULL: k owns OvS and Param, loaded before, and  *
+*                                builds Ocv. Else k borrows OvS, Ocv and Param  *
+*                                of owner, set up before and deleted last.      *
+*                                The steps only read the tables, so any number  *
+*                                of filters can share them, each on its own     *
+*                                thread                                         *
 *                                                                               *
 * RETURN VALUE: void                                                            *
 *                                                                               *
 ********************************************************************************/
 
-void vSetup(Kalman* k, const float T, const float* v_0)
+void vSetup(Kalman* k, const float* T, const float* v_0, const Kalman* owner)
 {
 
     k->x        = pxCreate(X_SIZE, 1);
-    k->Pk       = pxCreate(X_SIZE, X_SIZE);     
     k->Qk       = pxCreate(U_SIZE, U_SIZE);     
-    k->Rk       = pxCreate(Y_SIZE, Y_SIZE);      
-    k->Fk       = pxCreate(X_SIZE, X_SIZE);     
-    k->Gk       = pxCreate(X_SIZE, U_SIZE);     
-    k->Hk       = pxCreate(Y_SIZE, X_SIZE);     
-    k->D        = pxCreate(Y_SIZE, Y_SIZE); 
+    k->Rk       = pxSymCreate(Y_SIZE);
+    k->y_p      = pxCreate(Y_SIZE, 1);
+
+#if EKF_ENGINE == EKF_DENSE
+    k->Pk       = pxSymCreate(X_SIZE);
+    k->Fk       = pxDiagCreate(X_SIZE);
+    k->Gk       = pxSpCreate(X_SIZE, U_SIZE, X_SIZE);
+    k->Hk       = pxSpCreate(Y_SIZE, X_SIZE, CELL_STATES * Y_SIZE);
+    k->D        = pxDiagCreate(Y_SIZE);
+    k->Kk       = pxCreate(Y_SIZE, X_SIZE);
+    k->Sk       = pxSymCreate(Y_SIZE);
+    k->int_Gku  = pxCreate(X_SIZE, 1);
+
+    vCreateWorkspace(&k->ws);
+#else
+    k->Pc       = pxBlkDiagCreate(CELL_STATES, N_CELLS);
+#if EKF_GAIN_SCHED
+    k->Gs       = pxCreate(GS_BINS, GS_COLS);
+#endif
+#endif
 
-    /* Let's suppose 1st elem is a series module formed by PAR cells in parallel */
+    /* Let's suppose 1st elem is a series module formed by N_PAR cells in parallel */
     for (size_t i = 0; i < Y_SIZE; i++)
     {
-        i_prev[i] = 0;
-        i_sign[i] = 0;
+        k->i_prev[i] = 0;
+        k->i_sign[i] = 0;
+        k->gs_of[i]  = -1;
+        k->q_ratio[i] = 1;
 
-        k->x->matrix[I_IND + i][0]          = i_prev[i];
+        k->rest[i].n    = 0;
+        k->rest[i].y    = NAN;
+        k->rest[i].skip = 0;
+
+        k->x->matrix[I_IND + i][0]          = k->i_prev[i];
         k->x->matrix[H_IND + i][0]          = 0;
 
-        k->Pk->matrix[I_IND + i][I_IND + i] = 100;
-        k->Pk->matrix[H_IND + i][H_IND + i] = 0.01;
-        k->Pk->matrix[Z_IND + i][Z_IND + i] = 0.001;
+#if EKF_ENGINE == EKF_DENSE
+        SYM(k->Pk, I_IND + i, I_IND + i) = 100;
+        SYM(k->Pk, H_IND + i, H_IND + i) = 0.01;
+        SYM(k->Pk, Z_IND + i, Z_IND + i) = 0.001;
+#else
+        BLK(k->Pc, i, 0, 0) = 100;
+        BLK(k->Pc, i, 1, 1) = 0.01;
+        BLK(k->Pc, i, 2, 2) = 0.001;
+#endif
+
+        SYM(k->Rk, i, i) = 0.3;
+    }
+
+#if EKF_ENGINE == EKF_DENSE
+    /* Sparsity patterns, row by row: the values are set at every step */
+    for (size_t i = 0; i < X_SIZE; i++)
+        iSpInsert(k->Gk, i, i % N_CELLS, 0);
 
-        k->Rk->matrix[i][i] = 0.3;
+    for (size_t i = 0; i < Y_SIZE; i++)
+    {
+        iSpInsert(k->Hk, i, I_IND + i, 0);
+        iSpInsert(k->Hk, i, H_IND + i, 0);
+        iSpInsert(k->Hk, i, Z_IND + i, 0);
+        k->D->d[i] = 1;
     }
+#endif
     
+    /* The current of a lumped cell is the sum of LUMP measured ones */
     for (size_t i = 0; i < U_SIZE; i++)
-        k->Qk->matrix[i][i] = 4;
+        k->Qk->matrix[i][i] = 4 * LUMP;
+
+    /* Set here whatever k held before, vDelete frees the tables only if they are owned */
+    k->shared = (owner != NULL);
+
+    if (k->shared)
+    {
+        k->OvS   = owner->OvS;
+        k->Ocv   = owner->Ocv;
+        k->Param = owner->Param;
+    }
+    else
+    {
+        k->Ocv = pxOCVModelCreate(k->OvS);
+    }
 
     for (size_t i = 0; i < SER; i++)
     {
 
-        k->x->matrix[Z_IND + i * PAR][0] = fSOCfromOCV(v_0[i] , T, k->OvS);
+        k->x->matrix[Z_IND + i * N_PAR][0] = fSOCfromOCV(v_0[i] , T[i * N_PAR], k->Ocv);
+
+        for (int j = 1; j < N_PAR; j++)
+            k->x->matrix[Z_IND + i * N_PAR + j][0] = k->x->matrix[Z_IND + i * N_PAR][0];
 
-        for (int j = 1; j < PAR; j++)
-            k->x->matrix[Z_IND + i * PAR + j][0] = k->x->matrix[Z_IND + i * PAR][0];
+    }
 
+    /* Empty slots, filled by the first vEKF_Step1 */
+    for (size_t i = 0; i < U_SIZE; i++)
+    {
+        k->Par.slot[i].T = NAN;
+        k->Par.of[i]  = 0;
+        k->Par.ref[i] = 0;
     }
+    k->Par.ref[0] = N_CELLS;
+    k->dt_carry   = 0;
+
+#if EKF_ADAPT != ADAPT_OFF
+    /* Empty windows, Rk and Qk keep the values above until they are full */
+    k->Nw.e = pxCreate(ADAPT_WIN, 2 * N_CELLS);
+    memset(k->Nw.sum, 0, sizeof(k->Nw.sum));
+    memset(k->Nw.pos, 0, sizeof(k->Nw.pos));
+    memset(k->Nw.n, 0, sizeof(k->Nw.n));
+#endif
+    
+}
+
+#if EKF_ENGINE == EKF_DENSE
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vCreateWorkspace                                               *
+*                                                                               *
+* PURPOSE: Allocates all the scratch matrices used by the EKF steps,            *
+*           so that vEKF_Step1 and vEKF_Step2 never call malloc or free         *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type              IO     Description                                *
+* --------- --------          --     ---------------------------------          *
+* ws        KalmanWorkspace*  O      Workspace to allocate                      *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
 
+static void vCreateWorkspace(KalmanWorkspace* ws)
+{
 
-    k->Kk    = pxCreate(X_SIZE, Y_SIZE);
-    k->y_p   = pxCreate(Y_SIZE, 1);
-    k->Sk    = pxCreate(Y_SIZE, Y_SIZE);
+    ws->GQ   = pxCreate(X_SIZE, U_SIZE);
+    ws->HP   = pxCreate(Y_SIZE, X_SIZE);
+#if EKF_UPDATE == EKF_UPD_SEQ
+    ws->SU   = NULL;
+    ws->KS   = NULL;
+    ws->PH   = pxCreate(X_SIZE, 1);
+    ws->DX   = pxCreate(X_SIZE, 1);
+#else
+    ws->SU   = pxSymCreate(Y_SIZE);
+    ws->KS   = pxCreate(Y_SIZE, X_SIZE);
+    ws->PH   = NULL;
+    ws->DX   = NULL;
+#endif
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vDestroyWorkspace                                              *
+*                                                                               *
+* PURPOSE: Frees all the scratch matrices used by the EKF steps                 *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type              IO     Description                                *
+* --------- --------          --     ---------------------------------          *
+* ws        KalmanWorkspace*  IO     Workspace to free                          *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vDestroyWorkspace(KalmanWorkspace* ws)
+{
+
+    vDestroy(ws->GQ);
+    vDestroy(ws->HP);
+    vSymDestroy(ws->SU);
+    vDestroy(ws->KS);
+    vDestroy(ws->PH);
+    vDestroy(ws->DX);
 
-    int_Gku  = pxCreate(X_SIZE, 1);
-    
 }
+#endif
 
 /************************************************************************************************************************************
 *                                                                                                                                   *
@@ -186,21 +361,23 @@ void vSetup(Kalman* k, const float T, const float* v_0)
 * k         Kalman*      IO     Kalman structure, contains                                                                          *
 *                                all matrices needed for the execution of                                                           *
 *                                the algorithm                                                                                      *
-* T         const float  I      Temperature of the cell                                                                             *
 * u         float        I      Current of the cell at time t                                                                       *
+* T         const float* I      Temperature of the cells at time t, N_CELLS values                                                  *
+* dt        const float  I      Time since the previous step in s, measured: overruns and jitter change the decays, not the SOC     *
 *                                                                                                                                   *
 * RETURN VALUE: void                                                                                                                *
 *                                                                                                                                   *
 ************************************************************************************************************************************/
 
-void vEKF_Step1(Kalman* k, float* u, const float T)
+void vEKF_Step1(Kalman* k, float* u, const float* T, const float dt)
 {
  /* LOCAL VARIABLES:
   * Variable      Type           Description
   * ------------- -------        ---------------
   * i             size_t         Loop counter
-  * j             size_t         Loop counter
-  * Parameters    float[8]       Cell Parameters for a given T
+  * f             float[3]       Diagonal of the cell's block of Fk
+  * g             float[3]       Cell's column of Gk
+  * gu            float[3]       Cell's rows of int_Gku
   */
 
 #if DEBUG3
@@ -208,134 +385,147 @@ void vEKF_Step1(Kalman* k, float* u, const float T)
 #endif
 
     size_t i;
-    size_t j;
-
-    /* EKF Step1 Setup */
-    vGetParam(Parameters, T, k->Param);
+    float  f[CELL_STATES];
+    float  g[CELL_STATES];
+    float  gu[CELL_STATES];
 
-    Parameters[RC] = exp(-DeltaT / fabs(Parameters[RC]));
+    /* EKF Step1 Setup, only for the cells whose T left the bucket of their slot */
+    vGetParamBatch(&k->Par, T, fStepDt(&k->dt_carry, dt), k->Param);
 #if DEBUG_PRINT
     for (size_t i = 0; i < PARAM_SIZE - 1; i++)
     {
-        printf("%f\n", Parameters[i]);
+        printf("%f\n", CELL_PAR(k, 0)->p[i]);
     }
 #endif
 
-    for (i = 0; i < PAR * SER; i++)
+    for (i = 0; i < N_CELLS; i++)
     {
 
         if (u[i] < 0)
-            u[i] *= Parameters[eta];
+            u[i] *= CELL_PAR(k, i)->p[eta];
 
-        if (fabs(u[i]) > (Parameters[Q] / 100))
-            i_sign[i] = signum(u[i]);
+        if (fabs(u[i]) > CELL_PAR(k, i)->i_min)
+            k->i_sign[i] = signum(u[i]);
             
     }
 
 #if DEBUG_PRINT
-    printf("i_prev/sign: %f %d\n", i_prev[0], sign[0]);
+    printf("i_prev/sign: %f %d\n", k->i_prev[0], k->i_sign[0]);
 #endif
 
+#if EKF_ENGINE == EKF_DENSE
+
     /* Setting up the derivative matrices */
-    k->Fk->matrix[I_IND][I_IND] = Parameters[RC];
-    k->Fk->matrix[H_IND][H_IND] = exp(-fabs(i_prev[0] * Parameters[G] / (3600 * Parameters[Q])));
-    k->Fk->matrix[Z_IND][Z_IND] = 1;
+    for (i = 0; i < N_CELLS; i++)
+    {
+        vCellModel(k, i, f, g, gu);
 
-#if DEBUG_PRINT
-    printf("Fk\n");
-    vPrint(k->Fk);
-#endif
+        k->Fk->d[I_IND + i]                 = f[0];
+        k->Fk->d[H_IND + i]                 = f[1];
+        k->Fk->d[Z_IND + i]                 = f[2];
 
-    for (i = 1; i < PAR * SER; i++)
-    {
-        k->Fk->matrix[I_IND + i][I_IND + i] = Parameters[RC];
-        k->Fk->matrix[H_IND + i][H_IND + i] = exp(-fabs(i_prev[i] * Parameters[G] / (3600 * Parameters[Q])));
-        k->Fk->matrix[Z_IND + i][Z_IND + i] = 1;
-    }
+        *pxSpEntry(k->Gk, I_IND + i, i)     = g[0];
+        *pxSpEntry(k->Gk, H_IND + i, i)     = g[1];
+        *pxSpEntry(k->Gk, Z_IND + i, i)     = g[2];
 
-    k->Gk->matrix[I_IND][0]   = 1 - Parameters[RC];
-    k->Gk->matrix[Z_IND][0]   = -DeltaT / (3600 * Parameters[Q]);
-    int_Gku->matrix[Z_IND][0] = k->Gk->matrix[Z_IND][0] * i_prev[0];
-    int_Gku->matrix[I_IND][0] = k->Gk->matrix[I_IND][0] * i_prev[0];
-    int_Gku->matrix[H_IND][0] = (expf(-fabs(i_prev[0] * Parameters[G] * DeltaT / (3600 * Parameters[Q]))) - 1) * signum(i_prev[0]);
-    k->Gk->matrix[H_IND][0]   = -fabs(Parameters[G] * DeltaT / (3600 * Parameters[Q])) * expf(-fabs(i_prev[0] * Parameters[G] / (3600 * Parameters[Q]))) * (1 + signum(i_prev[0]) * k->x->matrix[H_IND][0]);
+        k->int_Gku->matrix[I_IND + i][0]    = gu[0];
+        k->int_Gku->matrix[H_IND + i][0]    = gu[1];
+        k->int_Gku->matrix[Z_IND + i][0]    = gu[2];
+    }
 
 #if DEBUG_PRINT
+    printf("Fk\n");
+    vDiagPrint(k->Fk);
     printf("Gk\n");
-    vPrint(k->Gk);
+    vSpPrint(k->Gk);
     printf("int_Gku\n");
-    vPrint(int_Gku);
+    vPrint(k->int_Gku);
 #endif
 
-    for (i = 1; i < PAR * SER; i++)
-    {
-
-        k->Gk->matrix[I_IND + i][i]             = 1 - Parameters[RC];
-        k->Gk->matrix[Z_IND + i][i]             = k->Gk->matrix[Z_IND][0];
-        int_Gku->matrix[Z_IND + i][0]           = k->Gk->matrix[Z_IND][0] * i_prev[i];
-        int_Gku->matrix[I_IND + i][0]           = k->Gk->matrix[I_IND][0] * i_prev[i];
-        int_Gku->matrix[H_IND + i][0]           = (expf(-fabs(i_prev[0] * Parameters[G] / (3600 * Parameters[Q]))) - 1) * signum(i_prev[i]);
-        k->Gk->matrix[H_IND + i][i + PAR * SER] = -fabs(Parameters[G] * DeltaT / (3600 * Parameters[Q])) * expf(-fabs(i_prev[i] * Parameters[G] / (3600 * Parameters[Q]))) * (1 + signum(i_prev[i]) * k->x->matrix[H_IND + i][0]);
-    }
-
-
-    /* EKF Step 1a */
-    app = pxMultiply(k->Fk, k->x);
-
-    SAFE_FUNC(iSum(k->x, app, int_Gku));
+    /* EKF Step 1a: x = Fk*x + int_Gku, accumulated in int_Gku */
+    SAFE_FUNC(iDiagGemm(k->int_Gku, k->Fk, k->x, 1, 1));
+    SAFE_FUNC(iCopy(k->x, k->int_Gku));
 #if DEBUG_PRINT
     printf("x_k\n");
     vPrint(k->x);
 #endif
 
-    /* EKF Step 1b */
-    app  = pxMultiply(k->Fk, k->Pk);
-    app2 = pxMultiply(k->Gk, k->Qk);
-    t1   = pxTranspose(k->Fk);
-    t2   = pxTranspose(k->Gk);
-    app3 = pxMultiply(app, t1); 
-    app4 = pxMultiply(app2, t2);
-
+    /* EKF Step 1b: Pk = Fk*Pk*Fk' + Gk*Qk*Gk' */
 #if DEBUG_PRINT
     printf("Pk\n");
-    vPrint(k->Pk);
+    vSymPrint(k->Pk);
 #endif
 
-    SAFE_FUNC(iSum(k->Pk, app3, app4));
+#if EKF_REST
+    /* All the cells at rest: the step is deferred, else the deferred steps are applied first */
+    for (i = 0; i < N_CELLS && iAtRest(k, i); i++)
+        ;
+
+    if (i == N_CELLS)
+    {
+        for (i = 0; i < N_CELLS; i++)
+            vRestDefer(k, i);
+    }
+    else
+    {
+        for (i = 0; i < N_CELLS; i++)
+            vRestFlush(k, i);
+
+        SAFE_FUNC(iCovPropagate(k->Pk, k->Fk, k->Gk, k->Qk, k->ws.GQ));
+    }
+#else
+    SAFE_FUNC(iCovPropagate(k->Pk, k->Fk, k->Gk, k->Qk, k->ws.GQ));
+#endif
 
 #if DEBUG_PRINT
     printf("Qk\n");
     vPrint(k->Qk);
     printf("Pk\n");
-    vPrint(k->Pk);
+    vSymPrint(k->Pk);
 #endif
 
-    vDestroy(app);
-    vDestroy(app2);
-    vDestroy(app3);
-    vDestroy(app4);
-    vDestroy(t1);
-    vDestroy(t2);
-    
+#else
 
-    /* EKF Step 1c */
+    /* EKF Step 1a and 1b, one 3x3 block at a time: P = F*P*F' + q*g*g' */
+    for (i = 0; i < N_CELLS; i++)
+    {
+        float* P = &BLK(k->Pc, i, 0, 0);
+        float  q = k->Qk->matrix[i][i];
+        size_t a;
+        size_t b;
 
-    
+        vCellModel(k, i, f, g, gu);
 
-    for (i = 0; i < PAR * SER; i++)
-    {
+        k->x->matrix[I_IND + i][0] = f[0] * k->x->matrix[I_IND + i][0] + gu[0];
+        k->x->matrix[H_IND + i][0] = f[1] * k->x->matrix[H_IND + i][0] + gu[1];
+        k->x->matrix[Z_IND + i][0] = f[2] * k->x->matrix[Z_IND + i][0] + gu[2];
 
-        k->y_p->matrix[i][0] = fOCVfromSOC(k->x->matrix[Z_IND + i][0], T, k->OvS);
-        k->y_p->matrix[i][0] = k->y_p->matrix[i][0] + (Parameters[M0] * i_sign[i] + Parameters[M] * k->x->matrix[H_IND + i][0] - Parameters[R] * k->x->matrix[I_IND + i][0] - Parameters[R0] * u[i]);
-    }
+#if EKF_GAIN_SCHED
+        /* A scheduled cell has no covariance to propagate */
+        if (k->gs_of[i] >= 0)
+            continue;
+#endif
 
-    for (i = 0; i < SER; i++)
-    {
-        i_prev[i] = u[i];
-        for (j = 0; j < PAR; j++)
-            i_prev[i + j] = i_prev[i];
+#if EKF_REST
+        if (iAtRest(k, i))
+        {
+            vRestDefer(k, i);
+            continue;
+        }
+        vRestFlush(k, i);
+#endif
 
+        for (a = 0; a < CELL_STATES; a++)
+        {
+            for (b = 0; b < CELL_STATES; b++)
+                P[CELL_STATES * a + b] = f[a] * P[CELL_STATES * a + b] * f[b] + g[a] * q * g[b];
+        }
     }
+
+#endif
+
+    for (i = 0; i < N_CELLS; i++)
+        k->i_prev[i] = u[i];
     
     #if DEBUG3
         printf("Kalman Filter Step 1 End\n");
@@ -349,6 +539,8 @@ void vEKF_Step1(Kalman* k, float* u, const float T)
 *                                                                                                                                   *
 * PURPOSE:                                                                                                                          *
 *   This function is used for the Update step of the EKF. (Kalman Filter Step 2)                                                    *
+*   It predicts the voltage from the state of the last vEKF_Step1, so that any number of predictions can run between two updates,  *
+*   the current of the last one standing for the current at time t                                                                  *
 *                                                                                                                                   *
 * ARGUMENT LIST:                                                                                                                    *
 *                                                                                                                                   *
@@ -359,157 +551,330 @@ void vEKF_Step1(Kalman* k, float* u, const float T)
 *                                the algorithm                                                                                      *
 * y         float*       I      Voltage of the cell at time t                                                                       *
 *                                                                                                                                   *
-* T         const float  I      Temperature at time t                                                                               *
+* T         const float* I      Temperature of the cells at time t, N_CELLS values                                                  *
 *                                                                                                                                   *
 * RETURN VALUE: void                                                                                                                *
 *                                                                                                                                   *
 ************************************************************************************************************************************/
 
-void vEKF_Step2(Kalman* k, float* y, const float T) //y is of size SER
+void vEKF_Step2(Kalman* k, float* y, const float* T) //y is of size SER
 {
 
     /* LOCAL VARIABLES:
   * Variable      Type           Description
   * ------------- -------        ---------------
   * i             size_t         Loop counter
-  * j             size_t         Loop counter
-  * z             size_t         Loop counter
-  * Parameters    float[8]       Cell Parameters for a given T
+  * r             float          Residual of the cell's voltage
   */
 
     size_t i;
-    size_t j;
-    size_t z;
+    float  r;
 
 #if DEBUG3
         printf("Kalman Filter Step 2 Begin\n");
 #endif
 
-    for (i = 0; i < PAR * SER; i++)
+#if EKF_REST
+    /* Nothing to do while all the cells rest at the voltage of their last update */
+    for (i = 0; i < N_CELLS && iRestSkip(k, i, y[i / N_PAR]); i++)
+        ;
+
+    if (i == N_CELLS)
+    {
+        for (i = 0; i < N_CELLS; i++)
+            k->rest[i].skip++;
+        return;
+    }
+#endif
+
+    /* EKF Step 2a, OCV and dOCV at the predicted SOC in one pass, only when there is a measurement */
+    vOCVdOCVfromSOCBatch(k->Ocv, &k->x->matrix[Z_IND][0], T, &k->y_p->matrix[0][0], k->docv, N_CELLS);
+
+    for (i = 0; i < N_CELLS; i++)
+    {
+        const float* p = CELL_PAR(k, i)->p;
+
+        k->y_p->matrix[i][0] = k->y_p->matrix[i][0] + (p[M0] * k->i_sign[i] + p[M] * k->x->matrix[H_IND + i][0] - p[R] * k->x->matrix[I_IND + i][0] - p[R0] * k->i_prev[i]);
+    }
+
+#if EKF_ENGINE == EKF_DENSE
+
+#if EKF_REST
+    /* The update is run for all the cells, on the covariance of all the steps */
+    for (i = 0; i < N_CELLS; i++)
+    {
+        vRestFlush(k, i);
+        k->rest[i].y    = y[i / N_PAR];
+        k->rest[i].skip = 0;
+    }
+#endif
+
+    for (i = 0; i < N_CELLS; i++)
     {
-        k->Hk->matrix[i][Z_IND + i] = fDOCVfromSOC(k->x->matrix[Z_IND + i][0], T, k->OvS);
-        k->Hk->matrix[i][H_IND + i] = Parameters[M];
-    	k->Hk->matrix[i][I_IND + i] = -Parameters[R];
-        k->D->matrix[i][i]          = 1;
+        *pxSpEntry(k->Hk, i, Z_IND + i) = k->docv[i];
+        *pxSpEntry(k->Hk, i, H_IND + i) = CELL_PAR(k, i)->p[M];
+        *pxSpEntry(k->Hk, i, I_IND + i) = -CELL_PAR(k, i)->p[R];
     }
 
 #if DEBUG_PRINT
     printf("Hk\n");
-    vPrint(k->Hk);
+    vSpPrint(k->Hk);
     printf("Rk\n");
-    vPrint(k->Rk);
+    vSymPrint(k->Rk);
 #endif
 
-    app  = pxMultiply(k->Hk, k->Pk);
-    app2 = pxMultiply(k->D, k->Rk);
-    t1   = pxTranspose(k->Hk);
-    t2   = pxTranspose(k->D);
-    app3 = pxMultiply(app, t1);
-    app4 = pxMultiply(app2, t2);
+#if EKF_UPDATE == EKF_UPD_SEQ
 
-    SAFE_FUNC(iSum(k->Sk, app3, app4));
+    /*
+     * Step 2a, 2b and 2c, one output at a time, Rk being diagonal: Sk of each output is a scalar
+     * and Pk takes a rank-1 update, so Sk is never factored. DX keeps the correction of the
+     * outputs already done, h being linearised at the predicted state as in the joint update
+     */
+    memset(k->ws.DX->data, 0, X_SIZE * sizeof(float));
 
-#if DEBUG_PRINT 
-    printf("Sk\n");
-    vPrint(k->Sk);
+    for (i = 0; i < N_CELLS; i++)
+    {
+        const SpMatrix* H = k->Hk;
+        float* ph = k->ws.PH->data;
+        float  s;
+        float  hdx;
+        size_t a;
+        size_t t;
+
+        /* Pk*h', Pk being conditioned on the outputs before i */
+        SAFE_FUNC(iSymSpRowMult(k->ws.PH, k->Hk, i, k->Pk));
+
+        s   = k->D->d[i] * SYM(k->Rk, i, i) * k->D->d[i];
+        hdx = 0;
+        for (t = H->row_ptr[i]; t < H->row_ptr[i + 1]; t++)
+        {
+            s   += H->val[t] * ph[H->col[t]];
+            hdx += H->val[t] * k->ws.DX->data[H->col[t]];
+        }
+        SYM(k->Sk, i, i) = s;
+
+        r = y[i / N_PAR] - k->y_p->matrix[i][0];
+        k->y_p->matrix[i][0] = r;
+        r -= hdx;
+
+#if EKF_ADAPT != ADAPT_OFF
+        {
+            const float K[CELL_STATES] = { ph[I_IND + i] / s, ph[H_IND + i] / s, ph[Z_IND + i] / s };
+            vAdaptNoise(k, i, r, s, K);
+        }
 #endif
 
-    vDestroy(app);
-    vDestroy(app2);
-    vDestroy(app3);
-    vDestroy(app4);
-    vDestroy(t1);
-    vDestroy(t2);
+        /* Same gating as the joint update, against the sequential Sk: the output is discarded */
+        if ((r * r) > 100 * s)
+        {
+            memset(k->Kk->matrix[i], 0, X_SIZE * sizeof(float));
+            continue;
+        }
+
+        for (a = 0; a < X_SIZE; a++)
+        {
+            const float g = ph[a] / s;
+
+            k->Kk->matrix[i][a]      = g;
+            k->x->matrix[a][0]      += g * r;
+            k->ws.DX->data[a]       += g * r;
+        }
 
-    t1  = pxTranspose(k->Hk);
-    app = pxMultiply(k->Pk, t1);
+        /* Pk = Pk - Pk*h'*h*Pk/s, upper triangle only */
+        SAFE_FUNC(iSymRank1(k->Pk, k->ws.PH, -1 / s));
+    }
 
 #if DEBUG_PRINT
-    printf("P_k\n");
-    vPrint(k->Pk);
-    printf("Hk'\n");
-    vPrint(t1);
+    printf("x_k\n");
+    vPrint(k->x);
+    printf("Pk\n");
+    vSymPrint(k->Pk);
 #endif
 
-    vDestroy(t1);
+#else
+
+    /* Sk = Hk*Pk*Hk' + D*Rk*D', upper triangles only, HP keeps Hk*Pk */
+    SAFE_FUNC(iSymSpCongruence(k->Sk, k->Hk, k->Pk, 1, 0, k->ws.HP));
+    SAFE_FUNC(iSymDiagCongruence(k->Sk, k->D, k->Rk, 1, 1));
+
+#if DEBUG_PRINT 
+    printf("Sk\n");
+    vSymPrint(k->Sk);
+    printf("P_k\n");
+    vSymPrint(k->Pk);
+    printf("HP\n");
+    vPrint(k->ws.HP);
+#endif
 
-    if (k->Sk->r == 1)
+    /* Kk' = Sk^-1*Hk*Pk, Pk and Sk being symmetric */
+    if (k->Sk->n == 1)
     {
         float f;
-        f = 1 / k->Sk->matrix[0][0];
-        SAFE_FUNC(iSc_Multiply(k->Kk, app, f));
+        f = 1 / k->Sk->data[0];
+        SAFE_FUNC(iSc_Multiply(k->Kk, k->ws.HP, f));
     }
 
     else
     {
-        t2 = pxInverse(k->Sk);
-
-        if (iMultiply(k->Kk, app, t2))
-            perror("Error Multiply");
-
-        vDestroy(t2);
+        /* By the Cholesky factor of Sk, the inverse is never formed */
+        SAFE_FUNC(iSymChol(k->ws.SU, k->Sk));
+        SAFE_FUNC(iSymCholSolve(k->Kk, k->ws.SU, k->ws.HP));
     }
 
-    vDestroy(app);
-
 #if DEBUG_PRINT
-    printf("Kk\n");
+    printf("Kk'\n");
     vPrint(k->Kk);
 #endif
 
     /*
      * Step 2b - State estimate update
      * Firstly I check for errors, so if the quadratic of residual between the input and yhat is
-     * greater than 100 times the covariance of y, then the first column of Kalman Gain is 0
+     * greater than 100 times the covariance of y, then the column of Kalman Gain of that cell is 0
      */
 
-    for (i = 0; i < SER; i++)
+    for (i = 0; i < N_CELLS; i++)
     {
-        for (j = 0; j < PAR; j++)
+        r = y[i / N_PAR] - k->y_p->matrix[i][0];
+
+#if EKF_ADAPT != ADAPT_OFF
         {
-            if (((y[i] - k->y_p->matrix[i + j][0]) * (y[i] - k->y_p->matrix[i + j][0])) > 100 * k->Sk->matrix[i + j][i + j])
-            {
-                for (z = i + j; z < 3 + i + j; z++)
-                    k->Kk->matrix[z][i + j] = 0;
-            }
+            const float K[CELL_STATES] = { k->Kk->matrix[i][I_IND + i], k->Kk->matrix[i][H_IND + i], k->Kk->matrix[i][Z_IND + i] };
+            vAdaptNoise(k, i, r, SYM(k->Sk, i, i), K);
         }
-    }
-
-#if DEBUG_PRINT
-    printf("Kk\n");
-    vPrint(Kk);
 #endif
 
-    for (i = 0; i < SER; i++)
-    {
-        k->y_p->matrix[i * PAR][0] = y[i] - k->y_p->matrix[i * PAR][0];
-
-        for (j = 1; j < PAR; j++)
-            k->y_p->matrix[i * PAR + j][0] = k->y_p->matrix[i * PAR][0];
+        if ((r * r) > 100 * SYM(k->Sk, i, i))
+            memset(k->Kk->matrix[i], 0, X_SIZE * sizeof(float));
 
+        k->y_p->matrix[i][0] = r;
     }
+
 #if DEBUG_PRINT
+    printf("Kk'\n");
+    vPrint(k->Kk);
     printf("r_k\n");
-    vPrint(y_p);
+    vPrint(k->y_p);
 #endif
 
-    t1   = pxCopy(k->x);
-    app = pxMultiply(k->Kk, k->y_p);
-
-    SAFE_FUNC(iSum(k->x, t1, app));
+    SAFE_FUNC(iGemm(k->x, k->Kk, MAT_TRANS, k->y_p, MAT_NOTRANS, 1, 1));
 
 #if DEBUG_PRINT
     printf("x_k\n");
     vPrint(k->x);
 #endif
-    vDestroy(app);
-    vDestroy(t1);
+
+    /* Step 2c - Error covariance measurement update */
+
+    /* Pk = Pk - Kk*Sk*Kk', upper triangle only, the gated rows of Kk' are skipped */
+    SAFE_FUNC(iSymCongruence(k->Pk, k->Kk, MAT_TRANS, k->Sk, -1, 1, k->ws.KS));
+
+#if DEBUG_PRINT
+    printf("Pk\n");
+    vSymPrint(k->Pk);
+#endif
+
+#endif /* EKF_UPDATE */
+
+#else
+
+    /* Step 2a, 2b and 2c, one cell at a time: a single output, so Sk is a scalar */
+    for (i = 0; i < N_CELLS; i++)
+    {
+        float* P = &BLK(k->Pc, i, 0, 0);
+        float  h[CELL_STATES];
+        float  K[CELL_STATES];
+        float  s;
+        size_t a;
+        size_t j;
+
+        r = y[i / N_PAR] - k->y_p->matrix[i][0];
+        k->y_p->matrix[i][0] = r;
+
+#if EKF_REST
+        if (iRestSkip(k, i, y[i / N_PAR]))
+        {
+            k->rest[i].skip++;
+            continue;
+        }
+        vRestFlush(k, i);
+        k->rest[i].y    = y[i / N_PAR];
+        k->rest[i].skip = 0;
+#endif
+
+#if EKF_GAIN_SCHED
+        int b = iGainBin(k->x->matrix[Z_IND + i][0], T[i], k->i_sign[i]);
+
+        /* The gain of the bin, while the cell, its step and its innovations agree with it */
+        if (k->gs_of[i] >= 0)
+        {
+            const float* gs = &MAT(k->Gs, k->gs_of[i], 0);
+
+            if ((k->gs_of[i] == b) && GS_DT_SAME(gs[GS_DT], CELL_PAR(k, i)->dt) && (gs[GS_N] >= GS_SETTLE))
+            {
+                s = gs[GS_S];
+                k->gs_nis[i] += GS_NIS_A * (r * r / s - k->gs_nis[i]);
+
+                if (k->gs_nis[i] <= GS_NIS_MAX)
+                {
+                    if ((r * r) <= 100 * s)
+                    {
+                        k->x->matrix[I_IND + i][0] += gs[GS_K + 0] * r;
+                        k->x->matrix[H_IND + i][0] += gs[GS_K + 1] * r;
+                        k->x->matrix[Z_IND + i][0] += gs[GS_K + 2] * r;
+                    }
+                    continue;
+                }
+            }
+
+            /* Back to the full update, from the predicted covariance of the bin */
+            memcpy(P, &gs[GS_PM], CELL_STATES * CELL_STATES * sizeof(float));
+            k->gs_of[i] = -1;
+        }
+#endif
+
+        h[0] = -CELL_PAR(k, i)->p[R];
+        h[1] = CELL_PAR(k, i)->p[M];
+        h[2] = k->docv[i];
+
+        s = SYM(k->Rk, i, i);
+        for (a = 0; a < CELL_STATES; a++)
+        {
+            K[a] = P[CELL_STATES * a + 0] * h[0] + P[CELL_STATES * a + 1] * h[1] + P[CELL_STATES * a + 2] * h[2];
+            s   += h[a] * K[a];
+        }
+        for (a = 0; a < CELL_STATES; a++)
+            K[a] /= s;
+
+#if EKF_GAIN_SCHED
+        vGainLearn(k, i, b, K, s, P);
+#endif
+
+#if EKF_ADAPT != ADAPT_OFF
+        vAdaptNoise(k, i, r, s, K);
+#endif
+
+        /* Same gating as the dense engine: the measurement is discarded */
+        if ((r * r) > 100 * s)
+            continue;
+
+        k->x->matrix[I_IND + i][0] += K[0] * r;
+        k->x->matrix[H_IND + i][0] += K[1] * r;
+        k->x->matrix[Z_IND + i][0] += K[2] * r;
+
+        for (a = 0; a < CELL_STATES; a++)
+        {
+            for (j = 0; j < CELL_STATES; j++)
+                P[CELL_STATES * a + j] -= K[a] * s * K[j];
+        }
+    }
+
+#endif
 
     /* Check if values are between ranges */
-    for (i = 0; i < PAR * SER; i++)
+    for (i = 0; i < N_CELLS; i++)
     {
-        c_assert((k->x->matrix[Z_IND + i][0] > 1.2) || (k->x->matrix[Z_IND + i][0] < -0.2));
-        c_assert((k->x->matrix[H_IND + i][0] > 1.2) || (k->x->matrix[H_IND + i][0] < -1.2));
+        c_assert((k->x->matrix[Z_IND + i][0] <= 1.2) && (k->x->matrix[Z_IND + i][0] >= -0.2));
+        c_assert((k->x->matrix[H_IND + i][0] <= 1.2) && (k->x->matrix[H_IND + i][0] >= -1.2));
         
         if (k->x->matrix[Z_IND + i][0] > 1) k->x->matrix[Z_IND + i][0] = 1;
         if (k->x->matrix[Z_IND + i][0] < 0) k->x->matrix[Z_IND + i][0] = 0;
@@ -517,282 +882,795 @@ void vEKF_Step2(Kalman* k, float* y, const float T) //y is of size SER
         if (k->x->matrix[H_IND + i][0] < -1) k->x->matrix[H_IND + i][0] = -1;
     }
 
-    /* Step 2c - Error covariance measurement update */
-
-    t1   = pxTranspose(k->Kk);
-    app  = pxMultiply(k->Kk, k->Sk);
-    app2 = pxMultiply(app, t1);
-    app3 = pxCopy(k->Pk);
-
-    SAFE_FUNC(iSubtract(k->Pk, app3, app2));
-
-#if DEBUG_PRINT
-    printf("Pk\n");
-    vPrint(k->Pk);
-#endif
-
-    vDestroy(app);
-    vDestroy(app2);
-    vDestroy(app3);
-    vDestroy(t1);
-
     #if DEBUG3
         printf("Kalman Filter Step 2 End\n");
     #endif
 }
 
-
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: vGetParam                                                      *
+* FUNCTION NAME: vCellModel                                                     *
 *                                                                               *
-* PURPOSE: This function returns the Parameters based on Temperature            *
+* PURPOSE: Computes the cell's block of the derivative matrices at time t:      *
+*           the diagonal of Fk, the column of Gk and the rows of int_Gku,       *
+*           ordered as current, hysteresis, SOC, from the constants             *
+*           of the ParamCache at the step dt: one exponential per cell          *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type          IO     Description                                    *
 * --------- --------      --     ---------------------------------              *
-* Params    float*        O      Parameters at Temp T                           *
-* T         const float   I      Temperature of the cell                        *
-* P         const Matrix* I      Matrix of the cell's parameters                *
+* k         const Kalman* I      Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+* f         float[3]      O      Diagonal of the Fk block                       *
+* g         float[3]      O      Column of Gk                                   *
+* gu        float[3]      O      Rows of int_Gku                                *
 *                                                                               *
 * RETURN VALUE: void                                                            *
 *                                                                               *
 ********************************************************************************/
-static void vGetParam(float* Params, const float T, const Matrix* P)
-{
-    /* LOCAL VARIABLES:
-     * Variable      Type    Description
-     * ------------- ------- -------------------------------------
-     * i             size_t  Loop counter
-     * j             size_t  Loop counter
-     */
 
-    size_t i;
-    size_t j;
+static void vCellModel(const Kalman* k, size_t c, float* f, float* g, float* gu)
+{
 
-    if (T <= P->matrix[TEMP][0])
-    {
-        for (i = 0; i < PARAM_SIZE; i++)
-            Params[i] = P->matrix[i][0];
-    }
-    else if (T >= P->matrix[TEMP][P->c-1]) 
-    {
-        for (i = 0; i < PARAM_SIZE; i++)
-            Params[i] = P->matrix[i][P->c];
-    }
-    else {
+    const ParamCache* p  = CELL_PAR(k, c);
+    const float       i  = k->i_prev[c];
+#if EKF_SOH
+    /* Both scale with 1 / Q, see vParamCacheStep */
+    const float       kg = p->kg * k->q_ratio[c];
+    const float       g2 = p->g2 * k->q_ratio[c];
+#else
+    const float       kg = p->kg;
+    const float       g2 = p->g2;
+#endif
+    const float       ea = expf(fabsf(i) * kg);
 
-        for (j = 0; j < P->c; j++)
-        {
-            if (P->matrix[TEMP][j] <= T && P->matrix[TEMP][j + 1] > T)
-                break;
-        }
+    f[0]  = p->f0;
+    f[1]  = ea;
+    f[2]  = 1;
 
-        for (i = 0; i < PARAM_SIZE - 1; i++)
-            Params[i] = P->matrix[i][j];
+    g[0]  = p->g0;
+    g[1]  = kg * ea * (1 + signum(i) * k->x->matrix[H_IND + c][0]);
+    g[2]  = g2;
 
-    }
+    gu[0] = g[0] * i;
+    gu[1] = (ea - 1) * signum(i);
+    gu[2] = g[2] * i;
 
 }
 
-
-
+#if EKF_GAIN_SCHED
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: fSOCfromOCV                                                    *
+* FUNCTION NAME: iGainBin                                                       *
 *                                                                               *
-* PURPOSE: Computing State of Charge starting from Open Circuit Voltage         *
-*  Computing state of charge by interpolation. Using the function:              *
-*      y=(x-x1)(y1-y0)/(x1-x0)+y0                                               *
-*  Where y is SOC, computed as:                                                 *
-*      SOC(z,t)=SOC0(z)+T*SOCrel(z)                                             *
+* PURPOSE: Returns the row of Kalman.Gs of a cell, its bin of SOC, temperature  *
+*           and sign of the current. Out of range values take the last bins     *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type          IO     Description                                    *
 * --------- --------      --     ---------------------------------              *
-* ocv       const float   I      OCV at time t                                  *
+* z         const float   I      SOC of the cell                                *
 * T         const float   I      Temperature of the cell                        *
-* OvS       const Matrix* I      Matrix of OCV vs SOC                           *
+* sign      const int     I      Sign of the last non-negligible current        *
 *                                                                               *
-* RETURN VALUE: s2                                                              *
-*             being cell's SOC                                                  *
+* RETURN VALUE: int                                                             *
 *                                                                               *
 ********************************************************************************/
-static float fSOCfromOCV(const float ocv, const float T, const Matrix* OvS)
+static int iGainBin(const float z, const float T, const int sign)
 {
     /* LOCAL VARIABLES:
      * Variable      Type    Description
-     * ------------- ------- ----------------
-     * i             size_t  Loop counter
-     * s1            float   Search help
-     * s2            float   state-of-charge
+     * ------------- ------- -------------------------------------
+     * zb            int     SOC bin
+     * tb            int     Temperature bin
      */
 
-    size_t i;
-    float s1;
-    float s2;
-
-    if (OvS->matrix[OCV][0] >= ocv) 
-    {
-        s1 = (OvS->matrix[SOC0][1] + T * OvS->matrix[SOCrel][1]) - (OvS->matrix[SOC0][0] + T * OvS->matrix[SOCrel][0]);
-        s2 = (ocv - OvS->matrix[OCV][1]) * s1 / (OvS->matrix[OCV][1] - OvS->matrix[OCV][0]) + OvS->matrix[SOC0][1] + OvS->matrix[SOCrel][1] * T;
-    }
-
-    else
-    {
-        for (i = 0; i < OvS->c; i++)
-        {
-            if (OvS->matrix[OCV][i] <= ocv && OvS->matrix[OCV][i + 1] >= ocv)
-                break;
-        }
-        if (i == OvS->c)
-        {
-            s1 = (OvS->matrix[SOC0][OvS->c] + T * OvS->matrix[SOCrel][OvS->c]) - (OvS->matrix[SOC0][OvS->c - 1] + T * OvS->matrix[SOCrel][OvS->c - 1]);
-            s2 = (ocv - OvS->matrix[OCV][OvS->c]) * s1 / (OvS->matrix[OCV][OvS->c] - OvS->matrix[OCV][OvS->c - 1]) + OvS->matrix[SOC0][OvS->c] + OvS->matrix[SOCrel][OvS->c] * T;
-        }
-        else
-        {
-            s1 = (OvS->matrix[SOC0][i + 1] + T * OvS->matrix[SOCrel][i + 1]) - (OvS->matrix[SOC0][i] + T * OvS->matrix[SOCrel][i]);
-            s2 = (ocv - OvS->matrix[OCV][i + 1]) * s1 / (OvS->matrix[OCV][i + 1] - OvS->matrix[OCV][i]) + OvS->matrix[SOC0][i + 1] + OvS->matrix[SOCrel][i + 1] * T;
-        }
-    }
+    int zb = (int)(z * GS_SOC_BINS);
+    int tb = (int)floorf((T - GS_T_MIN) / GS_T_RES);
 
-    return s2;
+    if (zb < 0) zb = 0;
+    if (zb > GS_SOC_BINS - 1) zb = GS_SOC_BINS - 1;
+    if (!(tb >= 0)) tb = 0;
+    if (tb > GS_T_BINS - 1) tb = GS_T_BINS - 1;
 
+    return ((sign + 1) * GS_T_BINS + tb) * GS_SOC_BINS + zb;
 }
 
-
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: fSOCfromOCV                                                    *
+* FUNCTION NAME: vGainLearn                                                     *
 *                                                                               *
-* PURPOSE: Computing Open Circuit Voltage starting from State of Charge         *
-*  Computing state of charge by interpolation. Using the function:              *
-*      y=(x-x1)(y1-y0)/(x1-x0)+y0                                               *
-*  Where y is SOC, computed as:                                                 *
-*      OCV(z,t)=OCV0(z)+T*OCVrel(z)                                             *
+* PURPOSE: Stores the gain of a full update in the bin of the cell. The bin     *
+*           counts the updates whose gain is within GS_K_TOL of the one         *
+*           before, at a step within GS_DT_TOL: after GS_SETTLE of them the     *
+*           gain is steady and the cell is scheduled on the bin                 *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type          IO     Description                                    *
 * --------- --------      --     ---------------------------------              *
-* soc       const float   I      SOC at time t                                  *
-* T         const float   I      Temperature of the cell                        *
-* OvS       const Matrix* I      Matrix of OCV vs SOC                           *
+* k         Kalman*       IO     Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+* b         int           I      Bin of the cell, see iGainBin                  *
+* K         const float*  I      Gain of the update, CELL_STATES values         *
+* s         const float   I      Innovation variance of the update              *
+* P         const float*  I      Predicted covariance of the cell, 3x3          *
 *                                                                               *
-* RETURN VALUE: ocv                                                             *
-*             being cell's OCV                                                  *
+* RETURN VALUE: void                                                            *
 *                                                                               *
 ********************************************************************************/
-static float fOCVfromSOC(const float soc, const float T, const Matrix* OvS)
+static void vGainLearn(Kalman* k, size_t c, int b, const float* K, const float s, const float* P)
 {
     /* LOCAL VARIABLES:
      * Variable      Type    Description
-     * ------------- ------- ----------------
-     * i             size_t  Loop counter
-     * s1            float   Search help
-     * ocv           float   open circuit voltage
+     * ------------- ------- -------------------------------------
+     * gs            float*  Row of the bin
+     * d             float   Change of the gain
+     * n             float   Size of the gain
+     * a             size_t  Loop counter
      */
 
-    size_t i = 0;
-    float  s1 = 0;
-    float  ocv = 0;
+    float* gs = &MAT(k->Gs, b, 0);
+    float  d  = 0;
+    float  n  = 0;
+    size_t a;
 
-    if (OvS->matrix[SOC][0] >= soc) 
+    for (a = 0; a < CELL_STATES; a++)
     {
-        s1 = (OvS->matrix[OCV0][1] + T * OvS->matrix[OCVrel][1]) - (OvS->matrix[OCV0][0] + T * OvS->matrix[OCVrel][0]);
-        ocv = (soc - OvS->matrix[SOC][1]) * s1 / (OvS->matrix[SOC][1] - OvS->matrix[SOC][0]) + OvS->matrix[OCV0][1] + OvS->matrix[OCVrel][1] * T;
+        d += fabsf(K[a] - gs[GS_K + a]);
+        n += fabsf(K[a]);
+        gs[GS_K + a] = K[a];
+    }
+
+    /* The step of the bin is the one its count started at, so that the jitter does not drift it */
+    if (GS_DT_SAME(gs[GS_DT], CELL_PAR(k, c)->dt) && (d <= GS_K_TOL * n))
+    {
+        if (gs[GS_N] < GS_SETTLE)
+            gs[GS_N]++;
     }
     else
     {
-        for (i = 0; i < OvS->c; i++)
-        {
-            if (OvS->matrix[SOC][i] <= soc && OvS->matrix[SOC][i + 1] >= soc)
-                break;
+        gs[GS_N]  = 0;
+        gs[GS_DT] = CELL_PAR(k, c)->dt;
+    }
+
+    gs[GS_S]  = s;
+    memcpy(&gs[GS_PM], P, CELL_STATES * CELL_STATES * sizeof(float));
+
+    if (gs[GS_N] >= GS_SETTLE)
+    {
+        k->gs_of[c]  = b;
+        k->gs_nis[c] = 0;
+    }
+}
+#endif
+
+#if EKF_REST
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iAtRest                                                        *
+*                                                                               *
+* PURPOSE: Returns 1 if the step of a cell can be deferred: its current is      *
+*           under the i_sign threshold and its parameters, of the temperature   *
+*           bucket, are those of the steps already deferred, 0 else.            *
+*           The dt of the steps can differ, see vRestFlush                      *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* k         const Kalman* I      Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*                                                                               *
+********************************************************************************/
+static int iAtRest(const Kalman* k, size_t c)
+{
+    const ParamCache* p  = CELL_PAR(k, c);
+    const RestCell*   rs = &k->rest[c];
+
+    if (fabsf(k->i_prev[c]) > p->i_min)
+        return 0;
+
+    return (rs->n == 0) || (rs->T == p->T);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iRestSkip                                                      *
+*                                                                               *
+* PURPOSE: Returns 1 if the update of a cell can be skipped: the cell is at     *
+*           rest, its voltage within REST_DV of the last update and less        *
+*           than REST_UPD_DIV - 1 updates have been skipped, 0 else             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* k         const Kalman* I      Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+* y         const float   I      Voltage of the cell at time t                  *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+*                                                                               *
+********************************************************************************/
+static int iRestSkip(const Kalman* k, size_t c, const float y)
+{
+    const RestCell* rs = &k->rest[c];
+
+    return (rs->n > 0) && (fabsf(y - rs->y) <= REST_DV) && (rs->skip < REST_UPD_DIV - 1);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vRestDefer                                                     *
+*                                                                               *
+* PURPOSE: Defers the covariance step of a cell at rest, see iAtRest            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* k         Kalman*       IO     Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+static void vRestDefer(Kalman* k, size_t c)
+{
+    const ParamCache* p  = CELL_PAR(k, c);
+    RestCell*         rs = &k->rest[c];
+
+    /* The constants of vParamCacheStep which do not depend on dt */
+    if (rs->n == 0)
+    {
+        rs->T  = p->T;
+        rs->rc = fabsf(p->p[RC]);
+        rs->ck = -fabsf(p->p[G] / p->q);
+        rs->c2 = -1 / p->q;
+        rs->s1 = 0;
+        rs->s2 = 0;
+    }
+
+    rs->n++;
+    rs->s1 += p->dt;
+    rs->s2 += p->dt * p->dt;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vRestFlush                                                     *
+*                                                                               *
+* PURPOSE: Applies the n deferred steps of a cell to its covariance at once.    *
+*           With no current F = diag(f0, 1, 1) and G = (g0, kg, g2), so that    *
+*           n steps of P = F*P*F' + q*G*G' are                                  *
+*           P(a,b) = (f_a*f_b)^n*P(a,b) + q*sum_{j<n} g_a*g_b*(f_a*f_b)^j       *
+*           The steps can have different dt: f0^n = exp(-sum dt/RC) and,        *
+*           kg and g2 being c*dt, their terms are q*c_a*c_b*sum dt^2, exact.    *
+*           The terms of the current state take the mean dt for g0 and the      *
+*           sum, exact when all the dt are equal.                               *
+*           EKF_DENSE scales the row and the column of the cell's current       *
+*           state by f0^n, the other cells not being deferred                   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* k         Kalman*       IO     Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+static void vRestFlush(Kalman* k, size_t c)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   -------------------------------------
+     * rs            RestCell* Deferred steps of the cell
+     * dt            float     Mean step
+     * f             float[3]  Diagonal of the F block, at the mean step
+     * g             float[3]  Column of G, at the mean step
+     * cs            float[3]  kg and g2 per s
+     * fn            float[3]  f^n
+     * q             float     Input noise of the cell
+     * a, b          size_t    States of the cell
+     * ff            float     f_a*f_b
+     * gg            float     Sum of g_a*g_b*ff^j
+     */
+
+    RestCell* rs = &k->rest[c];
+    float     dt;
+    float     f[CELL_STATES];
+    float     g[CELL_STATES];
+    float     cs[CELL_STATES];
+    float     fn[CELL_STATES];
+    float     q = k->Qk->matrix[c][c];
+    size_t    a;
+    size_t    b;
+
+    if (rs->n == 0)
+        return;
+
+    dt    = rs->s1 / rs->n;
+    cs[0] = 0;
+    cs[1] = rs->ck;
+    cs[2] = rs->c2;
+
+#if EKF_SOH
+    cs[1] *= k->q_ratio[c];
+    cs[2] *= k->q_ratio[c];
+#endif
+
+    f[0] = exp(-dt / rs->rc);   g[0] = 1 - f[0];
+    f[1] = 1;                   g[1] = cs[1] * dt;
+    f[2] = 1;                   g[2] = cs[2] * dt;
+
+    fn[0] = exp(-rs->s1 / rs->rc);
+    fn[1] = 1;
+    fn[2] = 1;
+
+#if EKF_ENGINE == EKF_DENSE
+    {
+        const size_t ind[CELL_STATES] = { I_IND + c, H_IND + c, Z_IND + c };
+        size_t x;
+
+        /* Covariances of the current state with the other cells */
+        for (x = 0; x < X_SIZE; x++)
+        {
+            if ((x != ind[0]) && (x != ind[1]) && (x != ind[2]))
+                SYM(k->Pk, (x < ind[0]) ? x : ind[0], (x < ind[0]) ? ind[0] : x) *= fn[0];
         }
-        if (i == OvS->c)
+
+        for (a = 0; a < CELL_STATES; a++)
         {
-            s1 = (OvS->matrix[OCV0][OvS->c] + T * OvS->matrix[OCVrel][OvS->c]) - (OvS->matrix[OCV0][OvS->c - 1] + T * OvS->matrix[OCVrel][OvS->c - 1]);
-            ocv = (soc - OvS->matrix[SOC][OvS->c]) * s1 / (OvS->matrix[SOC][OvS->c] - OvS->matrix[SOC][OvS->c - 1]) + OvS->matrix[OCV0][OvS->c] + OvS->matrix[OCVrel][OvS->c] * T;
+            for (b = a; b < CELL_STATES; b++)
+            {
+                const float ff = f[a] * f[b];
+                const float gg = (ff == 1) ? cs[a] * cs[b] * rs->s2 : g[a] * g[b] * (1 - fn[a] * fn[b]) / (1 - ff);
+
+                SYM(k->Pk, ind[a], ind[b]) = fn[a] * fn[b] * SYM(k->Pk, ind[a], ind[b]) + q * gg;
+            }
         }
-        else
+    }
+#else
+    {
+        float* P = &BLK(k->Pc, c, 0, 0);
+
+        for (a = 0; a < CELL_STATES; a++)
+        {
+            for (b = 0; b < CELL_STATES; b++)
+            {
+                const float ff = f[a] * f[b];
+                const float gg = (ff == 1) ? cs[a] * cs[b] * rs->s2 : g[a] * g[b] * (1 - fn[a] * fn[b]) / (1 - ff);
+
+                P[CELL_STATES * a + b] = fn[a] * fn[b] * P[CELL_STATES * a + b] + q * gg;
+            }
+        }
+    }
+#endif
+
+    rs->n = 0;
+}
+#endif
+
+#if EKF_ADAPT != ADAPT_OFF
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vAdaptNoise                                                    *
+*                                                                               *
+* PURPOSE: Adds the innovation of an update to the window of the cell and,      *
+*           once the window is full, sets its Rk (and Qk with ADAPT_RQ) to      *
+*           the mean of the samples. The sums are kept running, the oldest      *
+*           sample leaving as the new one enters: O(1) per update. They are     *
+*           double, so that the rounding of the float samples does not build up *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* k         Kalman*       IO     Kalman structure                               *
+* c         size_t        I      Index of the cell                              *
+* r         const float   I      Innovation of the cell                         *
+* s         const float   I      Its variance, h*Pk*h' + Rk                     *
+* K         const float*  I      Gain of the cell's states, CELL_STATES values  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+static void vAdaptNoise(Kalman* k, size_t c, const float r, const float s, const float* K)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       -------------------------------------
+     * w             NoiseWindow*  Windows of the cells
+     * e             float[2]      Samples of Rk and Qk
+     * rc            float         Innovation clipped at the gating bound
+     * p             size_t        Row of the samples
+     */
+
+    NoiseWindow* w  = &k->Nw;
+    float        e[2];
+    float        rc = r;
+    size_t       p  = w->pos[c];
+
+    /* A gated innovation counts as one on the bound, so that a too small Rk can grow back */
+    if ((r * r) > 100 * s)
+        rc = copysignf(10 * sqrtf(s), r);
+
+    e[0] = rc * rc - (s - SYM(k->Rk, c, c));
+    e[1] = 0;
+
+#if EKF_ADAPT == ADAPT_RQ
+    {
+        /* The correction K*r seen as the input noise q*g*g' of one step, projected on g */
+        float  f[CELL_STATES];
+        float  g[CELL_STATES];
+        float  gu[CELL_STATES];
+        float  gd = 0;
+        float  gg = 0;
+        size_t j;
+
+        vCellModel(k, c, f, g, gu);
+        for (j = 0; j < CELL_STATES; j++)
         {
-            s1 = (OvS->matrix[OCV0][i + 1] + T * OvS->matrix[OCVrel][i + 1]) - (OvS->matrix[OCV0][i] + T * OvS->matrix[OCVrel][i]);
-            ocv = (soc - OvS->matrix[SOC][i + 1]) * s1 / (OvS->matrix[SOC][i + 1] - OvS->matrix[SOC][i]) + OvS->matrix[OCV0][i + 1] + OvS->matrix[OCVrel][i + 1] * T;
+            gd += g[j] * K[j] * rc;
+            gg += g[j] * g[j];
         }
+        e[1] = (gd * gd) / (gg * gg);
     }
+#else
+    (void)K;
+#endif
+
+    w->sum[c]           += (double)e[0] - MAT(w->e, p, c);
+    w->sum[N_CELLS + c] += (double)e[1] - MAT(w->e, p, N_CELLS + c);
+    MAT(w->e, p, c)           = e[0];
+    MAT(w->e, p, N_CELLS + c) = e[1];
+
+    if (++w->pos[c] == ADAPT_WIN)
+        w->pos[c] = 0;
 
-    return ocv;
+    if (w->n[c] < ADAPT_WIN)
+        w->n[c]++;
 
+    if (w->n[c] == ADAPT_WIN)
+    {
+        SYM(k->Rk, c, c) = fmaxf((float)(w->sum[c] / ADAPT_WIN), ADAPT_R_MIN);
+#if EKF_ADAPT == ADAPT_RQ
+        k->Qk->matrix[c][c] = fmaxf((float)(w->sum[N_CELLS + c] / ADAPT_WIN), ADAPT_Q_MIN);
+#endif
+    }
 }
+#endif
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: fDOCVfromSOC                                                   *
+* FUNCTION NAME: vGetParam                                                      *
 *                                                                               *
-* PURPOSE: Computing derivative of Open Circuit Voltage                         *
-*           starting from State of Charge                                       *
-*  Computing state of charge by interpolation. Using the function:              *
-*      y=(x-x1)(y1-y0)/(x1-x0)+y0                                               *
-*  Where y is SOC, computed as:                                                 *
-*      dOCV(z,t)=dOCV0(z)+T*dOCVrel(z)                                          *
+* PURPOSE: This function returns the Parameters based on Temperature,           *
+*           linearly interpolated between the temperatures of the model,        *
+*           those of the first or last one outside of them                      *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type          IO     Description                                    *
 * --------- --------      --     ---------------------------------              *
-* soc       const float   I      SOC at time t                                  *
+* Params    float*        O      Parameters at Temp T, PARAM_SIZE - 1 values    *
 * T         const float   I      Temperature of the cell                        *
-* OvS       const Matrix* I      Matrix of dOCV vs SOC                          *
+* P         const Matrix* I      Matrix of the cell's parameters                *
 *                                                                               *
-* RETURN VALUE: docv                                                            *
-*             being cell's dOCV                                                 *
+* RETURN VALUE: void                                                            *
 *                                                                               *
 ********************************************************************************/
-static float fDOCVfromSOC(const float soc, const float T, const Matrix* OvS)
+void vGetParam(float* Params, const float T, const Matrix* P)
 {
     /* LOCAL VARIABLES:
-     * Variable      Type    Description
-     * ------------- ------- ----------------
-     * i             size_t  Loop counter
-     * s1            float   Search help
-     * ocv           float   open circuit voltage
+     * Variable      Type          Description
+     * ------------- -------       -------------------------------------
+     * i             size_t        Loop counter
+     * j             size_t        First temperature of the bin of T
+     * t             const float*  Temperatures of the model
+     * w             float         Weight of the temperature j + 1
      */
 
-    size_t i = 0;
-    float  s1 = 0;
-    float  docv = 0;
+    size_t       i;
+    size_t       j;
+    const float* t = P->matrix[TEMP];
+    float        w;
 
-    if (OvS->matrix[SOC][0] >= soc) 
+    /* Also for a NaN temperature */
+    if (!(T > t[0]))
     {
-        s1 = (OvS->matrix[dOCV0][1] + T * OvS->matrix[dOCVrel][1]) - (OvS->matrix[dOCV0][0] + T * OvS->matrix[dOCVrel][0]);
-        docv = (soc - OvS->matrix[SOC][1]) * s1 / (OvS->matrix[SOC][1] - OvS->matrix[SOC][0]) + OvS->matrix[dOCV0][1] + OvS->matrix[dOCVrel][1] * T;
+        for (i = 0; i < PARAM_SIZE - 1; i++)
+            Params[i] = P->matrix[i][0];
     }
-    else
+    else if (T >= t[P->c - 1]) 
     {
-        for (i = 0; i < OvS->c; i++)
-        {
-            if (OvS->matrix[SOC][i] <= soc && OvS->matrix[SOC][i + 1] >= soc)
-                break;
-        }
-        if (i == OvS->c)
-        {
-            s1 = (OvS->matrix[dOCV0][OvS->c] + T * OvS->matrix[dOCVrel][OvS->c]) - (OvS->matrix[dOCV0][OvS->c - 1] + T * OvS->matrix[dOCVrel][OvS->c - 1]);
-            docv = (soc - OvS->matrix[SOC][OvS->c]) * s1 / (OvS->matrix[SOC][OvS->c] - OvS->matrix[SOC][OvS->c - 1]) + OvS->matrix[dOCV0][OvS->c] + OvS->matrix[dOCVrel][OvS->c] * T;
-        }
-        else
+        for (i = 0; i < PARAM_SIZE - 1; i++)
+            Params[i] = P->matrix[i][P->c - 1];
+    }
+    else {
+
+        for (j = 0; t[j + 1] <= T; j++)
+            ;
+
+        w = (T - t[j]) / (t[j + 1] - t[j]);
+
+        for (i = 0; i < PARAM_SIZE - 1; i++)
+            Params[i] = P->matrix[i][j] + w * (P->matrix[i][j + 1] - P->matrix[i][j]);
+
+    }
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fParamBucket                                                   *
+*                                                                               *
+* PURPOSE: Returns the center of the temperature bucket of T, the key of        *
+*           the ParamCache, T itself if PARAM_T_RES is 0                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* T         const float   I      Temperature of the cell                        *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+float fParamBucket(const float T)
+{
+
+    if (PARAM_T_RES > 0)
+        return nearbyintf(T / PARAM_T_RES) * PARAM_T_RES;
+
+    return T;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vParamCacheUpdate                                              *
+*                                                                               *
+* PURPOSE: Fills the cache with the parameters at temperature T, only if T     *
+*           is not in the bucket of PARAM_T_RES degrees already held: between   *
+*           two changes of the bucket a step reads the cache and computes       *
+*           nothing. The constants of the step are left to vParamCacheStep.     *
+*           With EKF_LUMP_PAR they are those of a group of LUMP cells           *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* pc        ParamCache*   IO     Cache, T = NAN when empty                      *
+* T         const float   I      Temperature of the cell                        *
+* P         const Matrix* I      Matrix of the cell's parameters                *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vParamCacheUpdate(ParamCache* pc, const float T, const Matrix* P)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type    Description
+     * ------------- ------- -------------------------------------
+     * t             float   Center of the bucket of T
+     */
+
+    float t = fParamBucket(T);
+
+    if (t == pc->T)
+        return;
+
+    pc->T = t;
+    vGetParam(pc->p, t, P);
+
+#if EKF_LUMP_PAR
+    /* LUMP cells in parallel: their capacities add up, their resistances are in parallel */
+    pc->p[Q]  *= LUMP;
+    pc->p[R]  /= LUMP;
+    pc->p[R0] /= LUMP;
+#endif
+
+    pc->q     = 3600 * pc->p[Q];
+    pc->i_min = pc->p[Q] / 100;
+    pc->dt    = NAN;
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vParamCacheStep                                                *
+*                                                                               *
+* PURPOSE: Computes the constants of a step of dt seconds: the decay of the     *
+*           RC current, the SOC change and the hysteresis exponent per A,       *
+*           only if dt is not the step they already hold                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* pc        ParamCache*   IO     Cache, filled by vParamCacheUpdate             *
+* dt        const float   I      Step in s, see fStepDt                         *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vParamCacheStep(ParamCache* pc, const float dt)
+{
+
+    if (dt == pc->dt)
+        return;
+
+    pc->dt = dt;
+    pc->f0 = exp(-dt / fabs(pc->p[RC]));
+    pc->g0 = 1 - pc->f0;
+    pc->g2 = -dt / pc->q;
+    pc->kg = -fabsf(pc->p[G] * dt / pc->q);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fStepDt                                                        *
+*                                                                               *
+* PURPOSE: Returns the step to use for a measured dt: dt plus the carried       *
+*           error of the previous steps, rounded to a multiple of DT_RES.       *
+*           The new error is carried, so that the sum of the steps follows      *
+*           the clock within DT_RES/2 and the SOC does not drift                *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* carry     float*        IO     Rounding error carried between the steps       *
+* dt        const float   I      Measured time since the previous step in s     *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+float fStepDt(float* carry, const float dt)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type    Description
+     * ------------- ------- -------------------------------------
+     * t             float   Time to account for
+     * h             float   Step
+     */
+
+    float t = dt + *carry;
+    float h = t;
+
+    c_assert(dt >= 0);
+
+    if (DT_RES > 0)
+        h = nearbyintf(t / DT_RES) * DT_RES;
+
+    *carry = t - h;
+    return h;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vGetParamBatch                                                 *
+*                                                                               *
+* PURPOSE: Gives every cell the ParamCache of its temperature bucket, at the    *
+*           step dt. A cell still in the bucket of its slot costs one           *
+*           comparison, the others move to the slot of their new bucket,        *
+*           filled only if no other cell has it: the parameters and the         *
+*           constants of the step are computed once per distinct bucket,        *
+*           not once per cell                                                   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* ps        ParamSet*     IO     Slots of the cells                             *
+* T         const float*  I      Temperature of the cells, U_SIZE values        *
+* dt        const float   I      Step in s, see fStepDt                         *
+* P         const Matrix* I      Matrix of the cell's parameters                *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vGetParamBatch(ParamSet* ps, const float* T, const float dt, const Matrix* P)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type    Description
+     * ------------- ------- -------------------------------------
+     * i             size_t  Loop counter
+     * s             int     Slot of the cell
+     * t             float   Bucket of the cell
+     */
+
+    size_t i;
+    int    s;
+    float  t;
+
+    for (i = 0; i < U_SIZE; i++)
+    {
+        t = fParamBucket(T[i]);
+        if (ps->slot[ps->of[i]].T == t)
+            continue;
+
+        ps->ref[ps->of[i]]--;
+
+        /* A slot with the bucket, even if free: its parameters are still valid */
+        for (s = 0; s < U_SIZE && ps->slot[s].T != t; s++)
+            ;
+
+        /* Else a free slot, there is one as this cell left its own */
+        if (s == U_SIZE)
         {
-            s1 = (OvS->matrix[dOCV0][i + 1] + T * OvS->matrix[dOCVrel][i + 1]) - (OvS->matrix[dOCV0][i] + T * OvS->matrix[dOCVrel][i]);
-            docv = (soc - OvS->matrix[SOC][i + 1]) * s1 / (OvS->matrix[SOC][i + 1] - OvS->matrix[SOC][i]) + OvS->matrix[dOCV0][i + 1] + OvS->matrix[dOCVrel][i + 1] * T;
+            for (s = 0; ps->ref[s] != 0; s++)
+                ;
+            vParamCacheUpdate(&ps->slot[s], T[i], P);
         }
+
+        ps->of[i] = s;
+        ps->ref[s]++;
     }
 
-    return docv;
+    /* Constants of the step, for the slots in use */
+    for (s = 0; s < U_SIZE; s++)
+    {
+        if (ps->ref[s] > 0)
+            vParamCacheStep(&ps->slot[s], dt);
+    }
 
 }
 
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fGetSOC                                                        *
+*                                                                               *
+* PURPOSE: Returns the estimated SOC of a cell, whatever the engine             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* k         const Kalman*  I      Kalman structure                              *
+* c         size_t         I      Index of the cell, 0 <= c < N_CELLS           *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+float fGetSOC(const Kalman* k, size_t c)
+{
+    return k->x->matrix[Z_IND + c][0];
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fGetSOCVar                                                     *
+*                                                                               *
+* PURPOSE: Returns the variance of the SOC estimate of a cell,                  *
+*           whatever the engine                                                 *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* k         const Kalman*  I      Kalman structure                              *
+* c         size_t         I      Index of the cell, 0 <= c < N_CELLS           *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+float fGetSOCVar(const Kalman* k, size_t c)
+{
+#if EKF_ENGINE == EKF_DENSE
+    return SYM(k->Pk, Z_IND + c, Z_IND + c);
+#else
+    return BLK(k->Pc, c, 2, 2);
+#endif
+}
 
 /********************************************************************************
 *                                                                               *
@@ -814,17 +1692,35 @@ static float fDOCVfromSOC(const float soc, const float T, const Matrix* OvS)
 void vDelete(Kalman* k) 
 {
     vDestroy(k->Qk);
-    vDestroy(k->Rk);
+    vSymDestroy(k->Rk);
     vDestroy(k->x);
-    vDestroy(k->Pk);
-    vDestroy(k->OvS);
-    vDestroy(k->Param);
-    vDestroy(k->Fk);
-    vDestroy(k->Gk);
-    vDestroy(k->Hk);
-    vDestroy(k->D);
-    vDestroy(k->Kk);
     vDestroy(k->y_p);
-    vDestroy(k->Sk);
-    vDestroy(int_Gku);
+    if (!k->shared)
+    {
+        vOCVModelDelete(k->Ocv);
+        vDestroy(k->OvS);
+        vDestroy(k->Param);
+    }
+
+    /* Only what vSetup created in this build, the other pointers are not set */
+#if EKF_ENGINE == EKF_DENSE
+    vSymDestroy(k->Pk);
+    vDiagDestroy(k->Fk);
+    vSpDestroy(k->Gk);
+    vSpDestroy(k->Hk);
+    vDiagDestroy(k->D);
+    vDestroy(k->Kk);
+    vSymDestroy(k->Sk);
+    vDestroy(k->int_Gku);
+    vDestroyWorkspace(&k->ws);
+#else
+    vBlkDiagDestroy(k->Pc);
+#if EKF_GAIN_SCHED
+    vDestroy(k->Gs);
+#endif
+#endif
+
+#if EKF_ADAPT != ADAPT_OFF
+    vDestroy(k->Nw.e);
+#endif
 }
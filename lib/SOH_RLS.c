@@ -0,0 +1,392 @@
+/****************************************************************************************
+* This file is part of The SoC_EKF_Linux Project.                                       *
+*                                                                                       *
+* Copyright � 2020-2021 By Nicola di Gruttola Giardino. All rights reserved.           *
+* @mail: nicoladgg@protonmail.com                                                       *
+*                                                                                       *
+* SoC_EKF_Linux is free software: you can redistribute it and/or modify                 *
+* it under the terms of the GNU General Public License as published by                  *
+* the Free Software Foundation, either version 3 of the License, or                     *
+* (at your option) any later version.                                                   *
+*                                                                                       *
+* SoC_EKF_Linux is distributed in the hope that it will be useful,                      *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+* GNU General Public License for more details.                                          *
+*                                                                                       *
+* You should have received a copy of the GNU General Public License                     *
+* along with The SoC_EKF_Linux Project.  If not, see <https://www.gnu.org/licenses/>.   *
+*                                                                                       *
+* In case of use of this project, I ask you to mention me, to whom it may concern.      *
+*****************************************************************************************/
+
+/****************************************************************************************************
+* FILE NAME: SOH_RLS.c                                                                              *
+*                                                                                                   *
+* PURPOSE: This library implements the Soh, the estimator of the capacity of the cells              *
+*           run at a low rate on the SOC of the EKF, see SOH_RLS.h                                  *
+*                                                                                                   *
+* FILE REFERENCES:                                                                                  *
+*                                                                                                   *
+*   Name    I/O     Description                                                                     *
+*   ----    ---     -----------                                                                     *
+*   none                                                                                            *
+*                                                                                                   *
+*                                                                                                   *
+* EXTERNAL VARIABLES:                                                                               *
+*                                                                                                   *
+* Source: <SOH_RLS.h>                                                                               *
+*                                                                                                   *
+* Name          Type        IO Description                                                          *
+* ------------- -------     -- -----------------------------                                        *
+*   h           Soh            Soh object                                                           *
+*   k           Kalman         Kalman object                                                        *
+*                                                                                                   *
+*                                                                                                   *
+* STATIC VARIABLES:                                                                                 *
+*                                                                                                   *
+*   Name     Type       I/O      Description                                                        *
+*   ----     ----       ---      -----------                                                        *
+*   none                                                                                            *
+*                                                                                                   *
+* EXTERNAL REFERENCES:                                                                              *
+*                                                                                                   *
+*  Name                       Description                                                           *
+*  -------------              -----------                                                           *
+*  none                                                                                             *
+*                                                                                                   *
+* ABNORMAL TERMINATION CONDITIONS, ERROR AND WARNING MESSAGES:                                      *
+*    none, compliant with the standard ISO9899:2011                                                 *
+*                                                                                                   *
+* ASSUMPTIONS, CONSTRAINTS, RESTRICTIONS:                                                           *
+*    vSohSetup, vSohFeed and fGetSOH are called by one thread, the Kalman thread, vSohUpdate        *
+*    by one other thread. vSohSetup after vSetup, vSohFeed after every vEKF_Step1.                  *
+*    For a point of the least squares of a cell, x is its coulomb count at the nominal capacity     *
+*    between two rests, at least SOH_DZ_MIN, and y the change of the SOC read on the OCV at         *
+*    those rests, y = phi*x with phi = Q_nominal / Q. The SOC of the EKF is not used, being         *
+*    the coulomb count at the capacity under estimate. A sample is kept by the Kalman thread        *
+*    while the queue is full, so that the samples always cover the time without gaps.              *
+*    The SOH thread can start before vSohSetup on a zeroed Soh: it reads nothing but the            *
+*    queue indexes until the first sample is pushed.                                                *
+*                                                                                                   *
+* NOTES: see documentations                                                                         *
+*                                                                                                   *
+* REQUIREMENTS/FUNCTIONAL SPECIFICATIONS REFERENCES:                                                *
+*                                                                                                   *
+* DEVELOPMENT HISTORY:                                                                              *
+*                                                                                                   *
+*   Date          Author            Change Id     Release     Description Of Change                 *
+*   ----          ------            ---------     ------      ----------------------                *
+*   17-10-2026    agent                            1          Project created                       *
+*                                                                                                   *
+****************************************************************************************************/
+
+#include "../include/SOH_RLS.h"
+
+/* Declare Prototypes */
+static int   iSohPush(Soh*);
+static void  vSohRLS(Soh*, size_t, const float, const float);
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSohSetup                                                      *
+*                                                                               *
+* PURPOSE: Initializes the estimator: every capacity nominal, empty queue       *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         Soh*          O      Soh structure                                  *
+* k         const Kalman* I      Kalman structure, after vSetup                 *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vSohSetup(Soh* h, const Kalman* k)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   -------------------------------------
+     * c             size_t    Loop counter, cells
+     */
+
+    size_t c;
+
+    h->Ocv = k->Ocv;
+
+    for (c = 0; c < N_CELLS; c++)
+    {
+        h->acc.v[c]    = 0;
+        h->acc.T[c]    = 0;
+        h->acc.dz[c]   = 0;
+        h->acc.rest[c] = 1;
+        h->i_last[c]   = k->i_prev[c];
+
+        h->phi[c]      = 1;
+        h->P[c]        = SOH_P0;
+        h->z_rest[c]   = NAN;
+        h->ax[c]       = 0;
+        h->n_rest[c]   = 0;
+        atomic_store_explicit(&h->pub[c], 1.0f, memory_order_relaxed);
+    }
+
+    h->n_acc = 0;
+    h->full  = 0;
+    atomic_store_explicit(&h->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->head, 0, memory_order_release);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSohFeed                                                       *
+*                                                                               *
+* PURPOSE: Kalman thread: adds the last step of the EKF to the sample, pushes   *
+*           it every SOH_DIV steps and then gives the published estimates       *
+*           to the EKF. Never waits: when the queue is full the sample is       *
+*           kept and pushed at the next time, covering both intervals           *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         Soh*          IO     Soh structure                                  *
+* k         Kalman*       IO     Kalman structure, after vEKF_Step1             *
+* y         const float*  I      Voltage of the groups, SER values              *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vSohFeed(Soh* h, Kalman* k, const float* y)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type               Description
+     * ------------- -------            -------------------------------------
+     * c             size_t             Loop counter, cells
+     * pc            const ParamCache*  Parameters of the cell
+     * p             const float*       Model parameters of the cell
+     */
+
+    size_t            c;
+    const ParamCache* pc;
+    const float*      p;
+
+    /* vEKF_Step1 stepped with the current of the step before, at the dt of its cache */
+    for (c = 0; c < N_CELLS; c++)
+    {
+        pc = CELL_PAR(k, c);
+
+        h->acc.dz[c]   += pc->g2 * h->i_last[c];
+        h->acc.rest[c] &= (fabsf(k->i_prev[c]) <= pc->i_min);
+        h->i_last[c]    = k->i_prev[c];
+    }
+
+    if (++h->n_acc < SOH_DIV)
+        return;
+
+    h->n_acc = 0;
+
+    /* The output equation of the EKF, without the OCV */
+    for (c = 0; c < N_CELLS; c++)
+    {
+        pc = CELL_PAR(k, c);
+        p  = pc->p;
+
+        h->acc.v[c] = y[c / N_PAR] - (p[M0] * k->i_sign[c] + p[M] * k->x->matrix[H_IND + c][0]
+                                      - p[R] * k->x->matrix[I_IND + c][0] - p[R0] * k->i_prev[c]);
+        h->acc.T[c] = pc->T;
+    }
+
+    if (iSohPush(h) == 0)
+    {
+        for (c = 0; c < N_CELLS; c++)
+        {
+            h->acc.dz[c]   = 0;
+            h->acc.rest[c] = 1;
+        }
+    }
+    else
+    {
+        h->full++;
+    }
+
+    for (c = 0; c < N_CELLS; c++)
+        k->q_ratio[c] = atomic_load_explicit(&h->pub[c], memory_order_relaxed);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSohUpdate                                                     *
+*                                                                               *
+* PURPOSE: SOH thread: pops all the samples of the queue. After SOH_REST        *
+*           samples at rest the SOC of a cell is read on the OCV and, if it     *
+*           moved by SOH_DZ_MIN since the last reading, a point is added        *
+*           to its least squares                                                *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         Soh*          IO     Soh structure                                  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+void vSohUpdate(Soh* h)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type              Description
+     * ------------- -------           -------------------------------------
+     * tail          unsigned int      Samples popped
+     * head          unsigned int      Samples pushed
+     * s             const SohSample*  Sample at the tail of the queue
+     * c             size_t            Loop counter, cells
+     * z             float             SOC read on the OCV
+     */
+
+    unsigned int     tail = atomic_load_explicit(&h->tail, memory_order_relaxed);
+    unsigned int     head = atomic_load_explicit(&h->head, memory_order_acquire);
+    const SohSample* s;
+    size_t           c;
+    float            z;
+
+    for (; tail != head; tail++)
+    {
+        s = &h->q[tail & (SOH_QLEN - 1)];
+
+        for (c = 0; c < N_CELLS; c++)
+        {
+            h->ax[c] += s->dz[c];
+
+            if (!s->rest[c])
+            {
+                h->n_rest[c] = 0;
+                continue;
+            }
+
+            /* Once per rest */
+            if (++h->n_rest[c] != SOH_REST)
+                continue;
+
+            z = fSOCfromOCV(s->v[c], s->T[c], h->Ocv);
+
+            if (isnan(h->z_rest[c]))
+            {
+                h->z_rest[c] = z;
+                h->ax[c]     = 0;
+            }
+            else if (fabsf(h->ax[c]) >= SOH_DZ_MIN)
+            {
+                vSohRLS(h, c, h->ax[c], z - h->z_rest[c]);
+                h->z_rest[c] = z;
+                h->ax[c]     = 0;
+            }
+        }
+
+        /* The slot can be written again */
+        atomic_store_explicit(&h->tail, tail + 1, memory_order_release);
+    }
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fGetSOH                                                        *
+*                                                                               *
+* PURPOSE: Returns the published capacity of a cell over the nominal one        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         const Soh*    I      Soh structure                                  *
+* c         size_t        I      Index of the cell                              *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+float fGetSOH(const Soh* h, size_t c)
+{
+
+    return 1 / atomic_load_explicit(&h->pub[c], memory_order_relaxed);
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSohPush                                                       *
+*                                                                               *
+* PURPOSE: Pushes the sample being accumulated, if the queue is not full        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         Soh*          IO     Soh structure                                  *
+*                                                                               *
+* RETURN VALUE: int, 0 if pushed, -1 if the queue is full                       *
+*                                                                               *
+********************************************************************************/
+static int iSohPush(Soh* h)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type          Description
+     * ------------- -------       -------------------------------------
+     * head          unsigned int  Samples pushed
+     */
+
+    unsigned int head = atomic_load_explicit(&h->head, memory_order_relaxed);
+
+    /* The SOH thread releases a slot after reading it */
+    if (head - atomic_load_explicit(&h->tail, memory_order_acquire) == SOH_QLEN)
+        return -1;
+
+    h->q[head & (SOH_QLEN - 1)] = h->acc;
+    atomic_store_explicit(&h->head, head + 1, memory_order_release);
+
+    return 0;
+
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSohRLS                                                        *
+*                                                                               *
+* PURPOSE: Adds the point (x, y) of a cell to its least squares, with           *
+*           forgetting factor SOH_LAMBDA, and publishes the estimate:           *
+*             K   = P*x / (lambda + x*P*x)                                      *
+*             phi = phi + K*(y - phi*x)                                         *
+*             P   = (1 - K*x)*P / lambda                                        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* h         Soh*          IO     Soh structure                                  *
+* c         size_t        I      Index of the cell                              *
+* x         const float   I      Nominal SOC change between the rests           *
+* y         const float   I      SOC change read on the OCV                     *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+static void vSohRLS(Soh* h, size_t c, const float x, const float y)
+{
+    /* LOCAL VARIABLES:
+     * Variable      Type      Description
+     * ------------- -------   -------------------------------------
+     * K             float     Gain
+     */
+
+    const float K = h->P[c] * x / (SOH_LAMBDA + x * h->P[c] * x);
+
+    h->phi[c] += K * (y - h->phi[c] * x);
+    h->P[c]    = (1 - K * x) * h->P[c] / SOH_LAMBDA;
+
+    /* phi = Q_nominal / Q */
+    h->phi[c] = fminf(fmaxf(h->phi[c], 1 / SOH_MAX), 1 / SOH_MIN);
+    atomic_store_explicit(&h->pub[c], h->phi[c], memory_order_relaxed);
+
+}
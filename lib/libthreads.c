@@ -66,6 +66,7 @@
 *   ----          ------            ---------     ------      ----------------------                *
 *   28-12-2020    N.di Gruttola                    1          V1 Created					        *
 *                  Giardino																		    *
+*   17-10-2026    agent                            2          fRt_elapsed, time between samples     *
 *                                                                                                   *
 *                                                                                                   *
 *                                                                                                   *
@@ -110,6 +111,45 @@ long lRt_gettime()
 	return ts.tv_nsec;
 }
 
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: fRt_elapsed                                                    *
+*                                                                               *
+* PURPOSE: Return the seconds since the time in last, using CLOCK_MONOTONIC,    *
+*           and store the current time in last                                  *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         			IO     Description                          *
+* --------- --------     			--     ---------------------------------    *
+* last      struct timespec*        IO     Time of the previous call            *
+*                                                                               *
+* RETURN VALUE: float                                                           *
+*                                                                               *
+********************************************************************************/
+
+float fRt_elapsed(struct timespec* last)
+{
+ /* LOCAL VARIABLES:
+  * Variable      Type           	Description
+  * ------------- -------        	---------------
+  * now           struct timespec 	struct that contains the actual time
+  * d             struct timespec 	Time since last
+  */
+	struct timespec now;
+	struct timespec d;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+	{
+		perror("clock_gettime() failed");
+		return 0;
+	}
+
+	vTs_minus(&now, last, &d);
+	*last = now;
+
+	return d.tv_sec + d.tv_nsec * 1e-9f;
+}
+
 /********************************************************************************
 *                                                                               *
 * FUNCTION NAME: vInc_period                                                    *
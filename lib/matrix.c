@@ -39,7 +39,8 @@
 * Name          Type    IO Description                                                              *
 * ------------- ------- -- -----------------------------                                            *
 *   m           Matrix      Matrix object, contains                                                 *
-*                             a float**, being the matrix, and 2 int, being rows and columns        *
+*                             a float*, being the row-major storage, a float** row view of it,      *
+*                             and 2 int, being rows and columns                                     *
 *                                                                                                   *
 *   v           Vector      Vector object, contains                                                 *
 *                             a float*, being the vector, and 1 int, being rows                     *
@@ -77,6 +78,21 @@
 *                   Giardino &                                  nomenclature                        *
 *                G. Di Cecio                                                                        *
 *                                                                                                   *
+*   17-10-2026   agent                              3         Single aligned row-major block per    *
+*                                                              matrix, kernels work on m->data      *
+*                                                                                                   *
+*   17-10-2026   agent                              4         iChol checks positive definiteness,   *
+*                                                              added iCholSolve                     *
+*   17-10-2026   agent                              5         Added iCovPropagate                   *
+*   17-10-2026   agent                              6         Added iGemm, iMultiply based on it    *
+*   17-10-2026   agent                              7         Cache blocked iGemm with AVX2, SSE    *
+*                                                              and scalar tile kernels              *
+*   17-10-2026   agent                              8         Packed symmetric SymMatrix and its    *
+*                                                              operations, iCovPropagate on it      *
+*   17-10-2026   agent                              9         DiagMatrix, BlkDiagMatrix, SpMatrix,  *
+*                                                              kernels skipping their zeros         *
+*   17-10-2026   agent                              10        iSymSpRowMult and iSymRank1, for the  *
+*                                                              sequential update of the EKF         *
 *                                                                                                   *
 ****************************************************************************************************/
 
@@ -84,17 +100,108 @@
 
 #include "../include/matrix.h"
 
+/* Heap accounting, atomic since filters may be set up concurrently from different threads */
+#define HEAP_ADD(n)     __atomic_add_fetch(&heap_usage, (int)(n), __ATOMIC_RELAXED)
+#define HEAP_SUB(n)     __atomic_sub_fetch(&heap_usage, (int)(n), __ATOMIC_RELAXED)
+
 /* Declare Prototypes */
 
 static float  vec_mult             (float *, float *, unsigned int);
 static int    row_scalar_multiply  (Matrix *, unsigned int , float);
+static size_t storage_size         (unsigned int , unsigned int);
+static int    alloc_storage        (Matrix *, unsigned int , unsigned int);
+static void   gemm_pack_b          (float *, const float *, size_t, size_t, size_t, size_t, size_t, size_t, size_t);
+static void   vec_axpy             (float *, float, const float *, size_t);
+static size_t sym_storage_size     (unsigned int);
+static size_t blk_storage_size     (unsigned int , unsigned int);
+static size_t sp_storage_size      (unsigned int , unsigned int);
+
+/* Tile kernels of iGemm, see matrix_kernel.h */
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIX_X86  1
+#else
+#define MATRIX_X86  0
+#endif
+
+#define MK_W        1
+#define MK_MR       4
+#define MK_NV       4
+#define MK_SUFFIX   _scalar
+#define MK_ATTR
+#include "../include/matrix_kernel.h"
+#undef MK_W
+#undef MK_MR
+#undef MK_NV
+#undef MK_SUFFIX
+#undef MK_ATTR
+
+#if MATRIX_X86
+
+#define MK_W        4
+#define MK_MR       4
+#define MK_NV       2
+#define MK_SUFFIX   _sse
+#define MK_ATTR     __attribute__((target("sse2")))
+#include "../include/matrix_kernel.h"
+#undef MK_W
+#undef MK_MR
+#undef MK_NV
+#undef MK_SUFFIX
+#undef MK_ATTR
+
+/* 6 x 16 tile: 12 accumulators + 2 rows of B + 1 broadcast of A in the 16 ymm registers */
+#define MK_W        8
+#define MK_MR       6
+#define MK_NV       2
+#define MK_SUFFIX   _avx2
+#if MATRIX_BITEXACT
+#define MK_ATTR     __attribute__((target("avx2")))
+#else
+#define MK_ATTR     __attribute__((target("avx2,fma")))     /* acc += a*b contracted to FMA */
+#endif
+#include "../include/matrix_kernel.h"
+#undef MK_W
+#undef MK_MR
+#undef MK_NV
+#undef MK_SUFFIX
+#undef MK_ATTR
+
+#endif
+
+typedef void (*GemmTile)(float*, size_t, const float*, size_t, size_t, const float*, size_t, float, size_t, size_t);
+
+typedef struct GemmKernel
+{
+    GemmTile tile;
+    size_t   mr;        /* rows of a tile */
+    size_t   nr;        /* columns of a tile */
+} GemmKernel;
+
+/* Indexed by MAT_KERNEL_* */
+static const GemmKernel gemm_kernels[] =
+{
+    { gemm_tile_scalar, 4, 4 },
+#if MATRIX_X86
+    { gemm_tile_sse,    4, 8 },
+    { gemm_tile_avx2,   6, 16 },
+#endif
+};
+
+static const GemmKernel* gemm_kernel = &gemm_kernels[MAT_KERNEL_SCALAR];
+
+/* Packed panels of op(B), one buffer per thread */
+#define GEMM_KC     256
+#define GEMM_NC     128
+static __thread float pack_b[GEMM_KC * GEMM_NC] __attribute__((aligned(MATRIX_ALIGN)));
 
 /********************************************************************************
 *                                                                               *
 * FUNCTION NAME: pxCreate                                                       *
 *                                                                               *
 * PURPOSE: Creates the object Matrix, and then fills it with zeros              *
-*           returning the pointer to the created matrix                         *
+*           returning the pointer to the created matrix.                        *
+*           The elements are stored row-major in one MATRIX_ALIGN aligned       *
+*           block, followed by the row view used by m->matrix[i][j]             *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *  
@@ -108,25 +215,98 @@ static int    row_scalar_multiply  (Matrix *, unsigned int , float);
 
 Matrix* pxCreate(unsigned int r, unsigned int c)
 {
-	size_t i;
 
     Matrix *m = (Matrix*) malloc(sizeof(Matrix));
-	  heap_usage += sizeof(Matrix);
-    m->matrix=(float**)malloc(r*sizeof(float*));
-	  heap_usage += r*sizeof(float*);
-    for (i=0; i < r; i++)
+    if (m == NULL)
     {
-        m->matrix[i] =(float *)malloc(c * sizeof(float));
-        heap_usage += c*sizeof(float);
+        perror("Error Create");
+        return NULL;
     }
+	  HEAP_ADD(sizeof(Matrix));
 
-    m->c = c;
-    m->r = r;
+    if (alloc_storage(m, r, c) < 0)
+    {
+        HEAP_SUB(sizeof(Matrix));
+        free(m);
+        perror("Error Create");
+        return NULL;
+    }
 
     iZeroMat(m);
     return (Matrix*) m;
 }
 
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: storage_size                                                   *
+*                                                                               *
+* PURPOSE: Returns the size in bytes of the block holding a r x c matrix:       *
+*           the elements, padded to MATRIX_ALIGN, followed by r row pointers    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* r         int          I      Number of rows                                  *
+* c         int          I      Number of columns                               *
+*                                                                               *
+* RETURN VALUE: size_t                                                          *
+********************************************************************************/
+
+static size_t storage_size(unsigned int r, unsigned int c)
+{
+    size_t elems = (size_t)r * c * sizeof(float);
+
+    /* Pad the elements so that the row view starts aligned, never return 0 */
+    elems = (elems + MATRIX_ALIGN) & ~((size_t)MATRIX_ALIGN - 1);
+
+    return elems + (size_t)r * sizeof(float*);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: alloc_storage                                                  *
+*                                                                               *
+* PURPOSE: Allocates the aligned block of a r x c matrix and builds the         *
+*           row view on it, the content is left uninitialized                   *
+*           returning -1 if failed, 0 if successfull                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m         Matrix*      IO     Matrix whose storage is allocated               *
+* r         int          I      Number of rows                                  *
+* c         int          I      Number of columns                               *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+
+static int alloc_storage(Matrix* m, unsigned int r, unsigned int c)
+{
+    size_t i;
+    size_t size = storage_size(r, c);
+    void*  block;
+
+    if (posix_memalign(&block, MATRIX_ALIGN, size) != 0)
+    {
+        return -1;
+    }
+    HEAP_ADD(size);
+
+    m->data   = (float*)block;
+    m->matrix = (float**)((char*)block + size - (size_t)r * sizeof(float*));
+    for (i = 0; i < r; i++)
+    {
+        m->matrix[i] = &m->data[i * c];
+    }
+
+    m->c = c;
+    m->r = r;
+
+    return 0;
+}
+
 /********************************************************************************
 *                                                                               *
 * FUNCTION NAME: iResize                                                        *
@@ -153,20 +333,24 @@ int iResize(Matrix* m, unsigned int r, unsigned int c)
         return -1;
     }
 
-    heap_usage -= (m->r + m->c);
-
+    Matrix old = *m;
     size_t i;
 
-    m->matrix=(float**)realloc(m->matrix, r*sizeof(float*));
-	  heap_usage += r*sizeof(float*);
+    if (alloc_storage(m, r, c) < 0)
+    {
+        *m = old;
+        return -1;
+    }
 
-    for (i=0; i < r; i++)
+    /* Keep the old elements in the top-left corner, zero the new ones */
+    iZeroMat(m);
+    for (i = 0; i < old.r; i++)
     {
-        m->matrix[i] =(float *)realloc(m->matrix[i], c * sizeof(float));
-        heap_usage += c*sizeof(float);
+        memcpy(&m->data[i * c], &old.data[i * old.c], old.c * sizeof(float));
     }
-    m->c = c;
-    m->r = r;
+
+    HEAP_SUB(storage_size(old.r, old.c));
+    free(old.data);
 
     return 0;
 }
@@ -191,10 +375,10 @@ Vector* pxVectorCreate(unsigned int n)
 {
 
     Vector* v = (Vector*) malloc(sizeof(Vector));
-    heap_usage += sizeof(Vector);
+    HEAP_ADD(sizeof(Vector));
     v->n = n;
     v->vector = (float*) malloc(n*sizeof(float));
-    heap_usage += n*sizeof(float);
+    HEAP_ADD(n*sizeof(float));
 
     return v;
 }
@@ -220,9 +404,9 @@ void vVectorDestroy(Vector* v)
     if(v != NULL)
     {
         free(v->vector);
-        heap_usage -= (v->n)*sizeof(float);
+        HEAP_SUB((v->n)*sizeof(float));
         free(v);
-        heap_usage -= sizeof(Vector);
+        HEAP_SUB(sizeof(Vector));
     }
 
 }
@@ -246,15 +430,9 @@ void vDestroy(Matrix* m)
 {
     if(m!=NULL)
     {
-        Matrix* p = m;
-        size_t i;
-        for (i=0; i < p->r; i++){
-	        heap_usage -= (p->c)*sizeof(float);
-	        free(p->matrix[i]);
-        }
-	    heap_usage -= (p->r)*sizeof(float*);
-        free(p->matrix);
-	    heap_usage -= sizeof(Matrix);
+	    HEAP_SUB(storage_size(m->r, m->c));
+        free(m->data);
+	    HEAP_SUB(sizeof(Matrix));
         free(m);
     }
 }
@@ -296,11 +474,11 @@ int iInverse(Matrix *invert, Matrix *m)
     {
         for (j = i + 1; j < (m)->c; j++)
         {
-            if ((m)->matrix[i][i] == 0)
+            if (MAT(m, i, i) == 0)
             {
                 for (l = i + 1; l < m->c; l++)
                 {
-                    if (m->matrix[l][l] != 0)
+                    if (MAT(m, l, l) != 0)
                     {
                         iRowSwap(m, i, l);
                         break;
@@ -308,7 +486,7 @@ int iInverse(Matrix *invert, Matrix *m)
                 }
                 continue;
             }
-            factor = (m)->matrix[i][j] / ((m)->matrix[i][i]);
+            factor = MAT(m, i, j) / (MAT(m, i, i));
             iReduce(invert, i, j, factor);
             iReduce((m), i, j, factor);
         }
@@ -319,11 +497,11 @@ int iInverse(Matrix *invert, Matrix *m)
     {
         for (j = i - 1; j >= 0; j--)
         {
-            if ((m)->matrix[i][i] == 0)
+            if (MAT(m, i, i) == 0)
                 continue;
             if (j == -1)
                 break;
-            factor = (m)->matrix[i][j] / ((m)->matrix[i][i]);
+            factor = MAT(m, i, j) / (MAT(m, i, i));
             iReduce(invert, i, j, factor);
             iReduce((m), i, j, factor);
         }
@@ -332,9 +510,9 @@ int iInverse(Matrix *invert, Matrix *m)
     /* scale everything to 1 */
     for (i = 0; i < (m)->r; i++)
     {
-        if ((m)->matrix[i][i] == 0)
+        if (MAT(m, i, i) == 0)
             continue;
-        factor = 1 / ((m)->matrix[i][i]);
+        factor = 1 / (MAT(m, i, i));
         row_scalar_multiply(invert, i, factor);
         row_scalar_multiply((m), i, factor);
     }
@@ -390,13 +568,7 @@ Matrix *pxInverse(Matrix *m)
 
 int iZeroMat(Matrix* m)
 {
-    size_t i;
-    size_t j;
-    for (i=0; i<m->r; i++)
-    {
-        for(j=0;j<m->c;j++)
-            m->matrix[i][j]=0;
-    }
+    memset(m->data, 0, (size_t)m->r * m->c * sizeof(float));
 
     return 0;
 }
@@ -433,301 +605,1833 @@ int iSum(Matrix* s, Matrix* m1, Matrix* m2)
         return -1;
     }
 
-    size_t i;
-    size_t j;
-    for (i=0; i<m1->r; i++)
+    size_t i;
+    size_t n = (size_t)m1->r * m1->c;
+    for (i=0; i<n; i++)
+    {
+        s->data[i]=m1->data[i]+m2->data[i];
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxSum                                                          *
+*                                                                               *
+* PURPOSE: Computes the sum of the matrices                                     *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* m2        Matrix*      I      Pointer to the 2nd object                       *
+*                                                                               *
+* RETURN VALUE: Matrix*                                                    		*
+********************************************************************************/
+
+Matrix* pxSum (Matrix* m1, Matrix* m2)
+{
+    Matrix* m3 = pxCreate(m1->r, m1->c);
+    int check = iSum(m3,m1,m2);
+    if(check<0)
+    {
+        vDestroy(m3);
+        return NULL;
+    }
+    else
+        return m3;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSubtract                                                      *
+*                                                                               *
+* PURPOSE: Computes the subtraction of the matrices                             *
+*           returning -1 if failed, 0 if successfull                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* m2        Matrix*      I      Pointer to the 2nd object                       *
+* s         Matrix*      O      Pointer to the subtract object                  *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSubtract(Matrix *s,Matrix* m1,Matrix* m2)
+{
+    if(m1==NULL || m2==NULL)
+    {
+        return -1;
+    }
+    if(m1->r != m2->r || m1->c != m2->c)
+    {
+        return -1;
+    }
+    size_t i;
+    size_t n = (size_t)m1->r * m1->c;
+    for (i=0; i<n; i++)
+    {
+        s->data[i]=m1->data[i]-m2->data[i];
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxSubtract                                                     *
+*                                                                               *
+* PURPOSE: Computes the subtraction of the matrices                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* m2        Matrix*      I      Pointer to the 2nd object                       *
+*                                                                               *
+* RETURN VALUE: Matrix*                                                         *
+********************************************************************************/
+
+Matrix* pxSubtract(Matrix* m1, Matrix* m2)
+{
+    Matrix* m3 = pxCreate(m1->r, m2->c);
+    int check = iSubtract(m3,m1,m2);
+    if(check<0)
+    {
+        vDestroy(m3);
+        return NULL;
+    }
+    else
+        return m3;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSc_multiply                                                   *
+*                                                                               *
+* PURPOSE: Multiplies the matrix to a scalar                                    *
+*           returning -1 if failed, 0 if successfull                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* f         float        I      Multiplier                                      *
+* s         Matrix*      O      Pointer to the result object     	            *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSc_Multiply(Matrix *s, Matrix* m1, float f)
+{
+    if(m1==NULL)
+    {
+        return -1;
+    }
+	if((s->c != m1->c) || (s->r != m1->r))
+    {
+		return -1;
+    }
+    size_t i;
+    size_t n = (size_t)m1->r * m1->c;
+    for (i = 0; i < n; i++)
+    {
+        s->data[i] = m1->data[i] * f;
+    }
+
+    return 0;
+}
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxSc_Multiply                                                  *
+*                                                                               *
+* PURPOSE: Multiplies the matrix to a scalar                                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* f         float        I      Multiplier                                      *
+*                                                                               *
+* RETURN VALUE: Matrix*                                                         *
+********************************************************************************/
+
+
+Matrix* pxSc_Multiply(Matrix* m, float f)
+{
+    Matrix* m3 = pxCreate(m->r,m->c);
+    int check = iSc_Multiply(m3,m,f);
+    if(check<0)
+    {
+        vDestroy(m3);
+        return NULL;
+    }
+    else
+        return m3;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iEquals                                                        *
+*                                                                               *
+* PURPOSE: Compares the 2 matrices                                              *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object                       *
+* m2        Matrix*      I      Pointer to the 2nd object                       *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iEquals(Matrix* m1, Matrix* m2)
+{
+    if(m1==NULL || m2==NULL)
+    {
+        return -1;
+    }
+    if(m1->r != m2->r || m1->c != m2->c)
+    {
+        return -1;
+    }
+    size_t i;
+    size_t n = (size_t)m1->r * m1->c;
+    for (i=0; i<n; i++)
+    {
+        if(m1->data[i]!=m2->data[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iMultiply                                                      *
+*                                                                               *
+* PURPOSE: Multiplies the 2 matrices, adding the result to product            *
+*            (see iGemm) returns -1 if failed, 0 if successfull                 *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object to multiply           *
+* m2        Matrix*      I      Pointer to the 2nd object to multiply           *
+* product   Matrix*      O      Pointer to the product object					*
+*					                                                            *
+* RETURN VALUE: int 	                                                        *
+********************************************************************************/
+int iMultiply(Matrix* product,Matrix *m1, Matrix *m2)
+{
+
+    /* product is not zeroed: the result is added to it */
+    return iGemm(product, m1, MAT_NOTRANS, m2, MAT_NOTRANS, 1, 1);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: gemm_pack_b                                                    *
+*                                                                               *
+* PURPOSE: Copies the block op(B)(pc..pc+kc, jc..jc+nc) in panels of nr         *
+*           columns, each panel k-major, the last one padded with zeros         *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* Bp        float*        O      Packed block                                   *
+* B         const float*  I      Storage of B                                   *
+* bs_k      size_t        I      Stride of op(B) along k                        *
+* bs_j      size_t        I      Stride of op(B) along j                        *
+* pc        size_t        I      First k of the block                           *
+* kc        size_t        I      Depth of the block                             *
+* jc        size_t        I      First column of the block                      *
+* nc        size_t        I      Columns of the block                           *
+* nr        size_t        I      Columns of a panel                             *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+static void gemm_pack_b(float* Bp, const float* B, size_t bs_k, size_t bs_j,
+                        size_t pc, size_t kc, size_t jc, size_t nc, size_t nr)
+{
+    size_t j;
+    size_t jj;
+    size_t k;
+
+    for (j = 0; j < nc; j += nr)
+    {
+        for (k = 0; k < kc; k++)
+        {
+            const float* b = &B[(pc + k) * bs_k + (jc + j) * bs_j];
+            for (jj = 0; jj < nr; jj++)
+                Bp[jj] = (j + jj < nc) ? b[jj * bs_j] : 0;
+            Bp += nr;
+        }
+    }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSetKernel                                                     *
+*                                                                               *
+* PURPOSE: Selects the tile kernel of iGemm. The widest one supported by the    *
+*           CPU is selected at startup. With MATRIX_BITEXACT the AVX2 kernel    *
+*           does not use FMA, so that all kernels give the same results         *
+*            returns -1 if the CPU does not support it, 0 if successfull        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* kernel    int          I      MAT_KERNEL_SCALAR, MAT_KERNEL_SSE or            *
+*                                MAT_KERNEL_AVX2                                *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSetKernel(int kernel)
+{
+    switch (kernel)
+    {
+    case MAT_KERNEL_SCALAR:
+        break;
+
+#if MATRIX_X86
+    case MAT_KERNEL_SSE:
+        if (!__builtin_cpu_supports("sse2"))
+            return -1;
+        break;
+
+    case MAT_KERNEL_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+            return -1;
+#if !MATRIX_BITEXACT
+        if (!__builtin_cpu_supports("fma"))
+            return -1;
+#endif
+        break;
+#endif
+
+    default:
+        return -1;
+    }
+
+    __atomic_store_n(&gemm_kernel, &gemm_kernels[kernel], __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iGetKernel                                                     *
+*                                                                               *
+* PURPOSE: Returns the tile kernel of iGemm, see iSetKernel                     *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iGetKernel()
+{
+    return (int)(__atomic_load_n(&gemm_kernel, __ATOMIC_RELAXED) - gemm_kernels);
+}
+
+/* Runs before main: the widest kernel the CPU supports */
+__attribute__((constructor)) static void gemm_select_kernel(void)
+{
+#if MATRIX_X86
+    if (iSetKernel(MAT_KERNEL_AVX2) && iSetKernel(MAT_KERNEL_SSE))
+#endif
+        iSetKernel(MAT_KERNEL_SCALAR);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iGemm                                                          *
+*                                                                               *
+* PURPOSE: General matrix multiply C = alpha*op(A)*op(B) + beta*C,              *
+*           op(X) being X or X' as given by transA/transB (MAT_NOTRANS or       *
+*           MAT_TRANS). The transposed operands are read through strides,       *
+*           never copied. With beta == 0 C is not read, so it may hold          *
+*           garbage. C must not be the same object as A or B.                   *
+*           Blocked for the caches and computed by the tile kernel chosen       *
+*           with iSetKernel, see matrix_kernel.h                                *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* C         Matrix*      IO     Pointer to the result object                    *
+* A         Matrix*      I      Pointer to the 1st object to multiply           *
+* transA    int          I      MAT_TRANS to use A'                             *
+* B         Matrix*      I      Pointer to the 2nd object to multiply           *
+* transB    int          I      MAT_TRANS to use B'                             *
+* alpha     float        I      Scale of the product                            *
+* beta      float        I      Scale of C                                      *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iGemm(Matrix* C, Matrix* A, int transA, Matrix* B, int transB, float alpha, float beta)
+{
+
+    size_t i;
+    size_t j;
+    size_t m;           /* rows of op(A) and C */
+    size_t n;           /* columns of op(B) and C */
+    size_t l;           /* columns of op(A), rows of op(B) */
+    size_t as_i;        /* stride of op(A) along i */
+    size_t as_k;        /* stride of op(A) along k */
+    size_t bs_k;        /* stride of op(B) along k */
+    size_t bs_j;        /* stride of op(B) along j */
+    size_t ic;
+    size_t jc;
+    size_t pc;
+    size_t mc;
+    size_t nc;
+    size_t kc;
+    const GemmKernel* g;
+    if (C == NULL || A == NULL || B == NULL)
+    {
+        return -1;
+    }
+    m    = transA ? A->c : A->r;
+    l    = transA ? A->r : A->c;
+    n    = transB ? B->r : B->c;
+    as_i = transA ? 1 : A->c;
+    as_k = transA ? A->c : 1;
+    bs_k = transB ? 1 : B->c;
+    bs_j = transB ? B->c : 1;
+    if ((transB ? B->c : B->r) != l)
+    {
+        return -1;
+    }
+    if ((C->r != m) || (C->c != n))
+    {
+        return -1;
+    }
+
+    if (beta == 0)
+        memset(C->data, 0, m * n * sizeof(float));
+    else if (beta != 1)
+    {
+        for (i = 0; i < m * n; i++)
+            C->data[i] *= beta;
+    }
+
+    if (m == 0 || n == 0 || l == 0)
+        return 0;
+
+    /* Narrow products (matrix * vector) would mostly compute padding with the wide tiles */
+    g = __atomic_load_n(&gemm_kernel, __ATOMIC_RELAXED);
+    if (n < g->nr)
+        g = &gemm_kernels[MAT_KERNEL_SCALAR];
+
+    /* Panels of GEMM_KC x GEMM_NC of op(B) packed in cache, C computed g->mr x g->nr at a time */
+    for (jc = 0; jc < n; jc += GEMM_NC)
+    {
+        nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+        for (pc = 0; pc < l; pc += GEMM_KC)
+        {
+            kc = (l - pc < GEMM_KC) ? l - pc : GEMM_KC;
+            gemm_pack_b(pack_b, B->data, bs_k, bs_j, pc, kc, jc, nc, g->nr);
+
+            for (ic = 0; ic < m; ic += g->mr)
+            {
+                mc = (m - ic < g->mr) ? m - ic : g->mr;
+                for (j = 0; j < nc; j += g->nr)
+                {
+                    g->tile(&C->data[ic * n + jc + j], n,
+                            &A->data[ic * as_i + pc * as_k], as_i, as_k,
+                            &pack_b[j * kc], kc, alpha,
+                            mc, (nc - j < g->nr) ? nc - j : g->nr);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxMultiply                                                     *
+*                                                                               *
+* PURPOSE: Multiplies the 2 matrices                                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* m1        Matrix*      I      Pointer to the 1st object to multiply           *
+* m2        Matrix*      I      Pointer to the 2nd object to multiply           *
+*					                                                            *
+* RETURN VALUE: Matrix*                                                         *
+********************************************************************************/
+
+Matrix*  pxMultiply (Matrix* m1, Matrix* m2)
+{
+
+    Matrix* m3 = pxCreate(m1->r, m2->c);
+    int check = iMultiply(m3,m1,m2);
+    if(check<0)
+    {
+        vDestroy(m3);
+        return NULL;
+    }
+    else
+        return m3;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vec_axpy                                                       *
+*                                                                               *
+* PURPOSE: y = y + a*x on n contiguous floats, 4 at a time on GCC vectors,      *
+*           the packed rows of SymMatrix being neither aligned nor padded       *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type          IO     Description                                    *
+* --------- --------      --     ---------------------------------              *
+* y         float*        IO     First element of y                             *
+* a         float         I      Scale of x                                     *
+* x         const float*  I      First element of x, not overlapping y          *
+* n         size_t        I      Number of elements                             *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+static void vec_axpy(float* y, float a, const float* x, size_t n)
+{
+    typedef float vf4 __attribute__((vector_size(16)));
+    size_t i = 0;
+    vf4    vx;
+    vf4    vy;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        memcpy(&vx, &x[i], sizeof(vf4));
+        memcpy(&vy, &y[i], sizeof(vf4));
+        vy += a * vx;
+        memcpy(&y[i], &vy, sizeof(vf4));
+    }
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: sym_storage_size                                               *
+*                                                                               *
+* PURPOSE: Returns the size in bytes of the packed upper triangle of a n x n    *
+*           symmetric matrix, padded to MATRIX_ALIGN, never 0                   *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* n         int          I      Number of rows and columns                      *
+*                                                                               *
+* RETURN VALUE: size_t                                                          *
+********************************************************************************/
+static size_t sym_storage_size(unsigned int n)
+{
+    size_t elems = (size_t)n * (n + 1) / 2 * sizeof(float);
+
+    return (elems + MATRIX_ALIGN) & ~((size_t)MATRIX_ALIGN - 1);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxSymCreate                                                    *
+*                                                                               *
+* PURPOSE: Creates the object SymMatrix, and then fills it with zeros           *
+*           returning the pointer to the created matrix.                        *
+*           Only the upper triangle is stored, row by row, in one               *
+*           MATRIX_ALIGN aligned block, element (i,j) being SYM(s, i, j)        *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* n         int          I      Number of rows and columns                      *
+*                                                                               *
+* RETURN VALUE: SymMatrix*                                                      *
+********************************************************************************/
+
+SymMatrix* pxSymCreate(unsigned int n)
+{
+
+    size_t     size = sym_storage_size(n);
+    void*      block;
+    SymMatrix* s = (SymMatrix*) malloc(sizeof(SymMatrix));
+    if (s == NULL)
+    {
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(sizeof(SymMatrix));
+
+    if (posix_memalign(&block, MATRIX_ALIGN, size) != 0)
+    {
+        HEAP_SUB(sizeof(SymMatrix));
+        free(s);
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(size);
+
+    s->data = (float*)block;
+    s->n    = n;
+    memset(s->data, 0, size);
+
+    return s;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSymDestroy                                                    *
+*                                                                               *
+* PURPOSE: Destroys the Object                                                  *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* s         SymMatrix*   I      Matrix to free                                  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+
+void vSymDestroy(SymMatrix* s)
+{
+    if (s != NULL)
+    {
+        HEAP_SUB(sym_storage_size(s->n));
+        free(s->data);
+        HEAP_SUB(sizeof(SymMatrix));
+        free(s);
+    }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymSum                                                        *
+*                                                                               *
+* PURPOSE: Sums two symmetric matrices on their packed triangles                *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* s         SymMatrix*   O      Pointer to the result object                    *
+* m1        SymMatrix*   I      Pointer to the first object                     *
+* m2        SymMatrix*   I      Pointer to the second object                    *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymSum(SymMatrix* s, SymMatrix* m1, SymMatrix* m2)
+{
+    size_t i;
+    size_t len;
+    if (s == NULL || m1 == NULL || m2 == NULL)
+    {
+        return -1;
+    }
+    if ((m1->n != m2->n) || (s->n != m1->n))
+    {
+        return -1;
+    }
+
+    len = (size_t)s->n * (s->n + 1) / 2;
+    for (i = 0; i < len; i++)
+        s->data[i] = m1->data[i] + m2->data[i];
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymSubtract                                                   *
+*                                                                               *
+* PURPOSE: Subtracts two symmetric matrices on their packed triangles           *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* s         SymMatrix*   O      Pointer to the result object, m1 - m2           *
+* m1        SymMatrix*   I      Pointer to the first object                     *
+* m2        SymMatrix*   I      Pointer to the second object                    *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymSubtract(SymMatrix* s, SymMatrix* m1, SymMatrix* m2)
+{
+    size_t i;
+    size_t len;
+    if (s == NULL || m1 == NULL || m2 == NULL)
+    {
+        return -1;
+    }
+    if ((m1->n != m2->n) || (s->n != m1->n))
+    {
+        return -1;
+    }
+
+    len = (size_t)s->n * (s->n + 1) / 2;
+    for (i = 0; i < len; i++)
+        s->data[i] = m1->data[i] - m2->data[i];
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymCongruence                                                 *
+*                                                                               *
+* PURPOSE: Computes S = alpha*op(A)*P*op(A)' + beta*S on packed triangles,      *
+*           op(A) being A (m x n) or A' (A being n x m) as per transA.          *
+*           W receives op(A)*P (MAT_NOTRANS, m x n) or P*A (MAT_TRANS, n x m),  *
+*           then only the upper triangle of S is computed from it.              *
+*           Zero entries of A are skipped; with MAT_TRANS the inner loops run   *
+*           along the rows of A and W, so A should then be the wider operand.   *
+*           P is only read to form W, S and P can be the same object           *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* S         SymMatrix*   IO     Result, m x m                                   *
+* A         Matrix*      I      m x n, or n x m with MAT_TRANS                  *
+* transA    int          I      MAT_NOTRANS or MAT_TRANS                        *
+* P         SymMatrix*   I      Symmetric matrix, n x n                         *
+* alpha     float        I      Scale of the congruence                         *
+* beta      float        I      Scale of S, 0 to overwrite it                   *
+* W         Matrix*      O      Scratch object, op(A)*P or P*A                  *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymCongruence(SymMatrix* S, Matrix* A, int transA, SymMatrix* P, float alpha, float beta, Matrix* W)
+{
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t l;
+    size_t p;
+    size_t m;
+    size_t n;
+    if (S == NULL || A == NULL || P == NULL || W == NULL)
+    {
+        return -1;
+    }
+    m = S->n;
+    n = P->n;
+    if (transA == MAT_NOTRANS)
+    {
+        if ((A->r != m) || (A->c != n) || (W->r != m) || (W->c != n))
+            return -1;
+    }
+    else
+    {
+        if ((A->r != n) || (A->c != m) || (W->r != n) || (W->c != m))
+            return -1;
+    }
+
+    if (transA == MAT_NOTRANS)
+    {
+        /* W(i,:) = sum_l A(i,l)*P(l,:), P(l,l..n-1) being row l of the packing, P(0..l-1,l) its column */
+        for (i = 0; i < m; i++)
+        {
+            float* w = &MAT(W, i, 0);
+            memset(w, 0, n * sizeof(float));
+            for (l = 0; l < n; l++)
+            {
+                const float a = MAT(A, i, l);
+                if (a == 0)
+                    continue;
+                vec_axpy(&w[l], a, &SYM(P, l, l), n - l);
+                for (k = 0, p = l; k < l; p += n - k - 1, k++)
+                    w[k] += a * P->data[p];
+            }
+        }
+    }
+    else
+    {
+        /* W(k,:) = sum_l P(k,l)*A(l,:) */
+        for (k = 0; k < n; k++)
+        {
+            float* w = &MAT(W, k, 0);
+            memset(w, 0, m * sizeof(float));
+            for (l = 0, p = k; l < n; l++)
+            {
+                const float pk = (l < k) ? P->data[p] : SYM(P, k, l);
+                if (l < k)
+                    p += n - l - 1;
+                if (pk == 0)
+                    continue;
+                vec_axpy(w, pk, &MAT(A, l, 0), m);
+            }
+        }
+    }
+
+    /* Upper triangle only: S(i,j) = beta*S(i,j) + alpha*sum_k op(A)(i,k)*W'(k,j) */
+    for (i = 0; i < m; i++)
+    {
+        float* s = &SYM(S, i, i);
+
+        if (beta == 0)
+            memset(s, 0, (m - i) * sizeof(float));
+        else if (beta != 1)
+        {
+            for (j = 0; j < m - i; j++)
+                s[j] *= beta;
+        }
+
+        for (k = 0; k < n; k++)
+        {
+            if (transA == MAT_NOTRANS)
+            {
+                const float a = alpha * MAT(A, i, k);
+                if (a == 0)
+                    continue;
+                for (j = i; j < m; j++)
+                    s[j - i] += a * MAT(W, j, k);
+            }
+            else
+            {
+                const float a = alpha * MAT(A, k, i);
+                if (a == 0)
+                    continue;
+                vec_axpy(s, a, &MAT(W, k, i), m - i);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymChol                                                       *
+*                                                                               *
+* PURPOSE: Computes the Cholesky factorization m = U'*U of a symmetric          *
+*           positive definite matrix, U being upper triangular and packed       *
+*           like m. Each row of U updates the trailing rows, so the inner       *
+*           loops run along the packed rows. m and U can be the same            *
+*           returning -1 if failed, i.e. m is not positive definite,            *
+*           0 if successfull                                                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* U         SymMatrix*   O      Pointer to the result object                    *
+* m         SymMatrix*   I      Pointer to the object                           *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymChol(SymMatrix* U, SymMatrix* m)
+{
+    size_t i;
+    size_t j;
+    size_t r;
+    size_t n;
+    if (U == NULL || m == NULL)
+    {
+        return -1;
+    }
+    if (U->n != m->n)
+    {
+        return -1;
+    }
+    n = U->n;
+    if (U != m)
+        memcpy(U->data, m->data, n * (n + 1) / 2 * sizeof(float));
+
+    for (i = 0; i < n; i++)
+    {
+        float* u = &SYM(U, i, i);
+        float  d = u[0];
+
+        /* Not positive definite, also catches NaN */
+        if (!(d > 0))
+            return -1;
+        d = sqrtf(d);
+        u[0] = d;
+        for (j = 1; j < n - i; j++)
+            u[j] /= d;
+
+        for (r = i + 1; r < n; r++)
+            vec_axpy(&SYM(U, r, r), -u[r - i], &u[r - i], n - r);
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymCholSolve                                                  *
+*                                                                               *
+* PURPOSE: Computes x = S^-1*b given the Cholesky factor U of S (see iSymChol), *
+*           without forming the inverse: U'*y = b by forward substitution and   *
+*           U*x = y by back substitution, a whole row of x at a time.           *
+*           x and b can be the same                                             *
+*           returning -1 if failed, 0 if successfull                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* x         Matrix*      O      Pointer to the result object, n x c             *
+* U         SymMatrix*   I      Cholesky factor of S, n x n                     *
+* b         Matrix*      I      Pointer to the object, n x c                    *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymCholSolve(Matrix* x, SymMatrix* U, Matrix* b)
+{
+    size_t i;
+    size_t j;
+    size_t n;
+    size_t c;
+    if (x == NULL || U == NULL || b == NULL)
+    {
+        return -1;
+    }
+    if ((b->r != U->n) || (x->r != b->r) || (x->c != b->c))
+    {
+        return -1;
+    }
+    n = U->n;
+    c = x->c;
+    if (x != b)
+        memcpy(x->data, b->data, n * c * sizeof(float));
+
+    for (i = 0; i < n; i++)
+    {
+        float* xi = &MAT(x, i, 0);
+        const float d = SYM(U, i, i);
+
+        for (j = 0; j < c; j++)
+            xi[j] /= d;
+        for (j = i + 1; j < n; j++)
+            vec_axpy(&MAT(x, j, 0), -SYM(U, i, j), xi, c);
+    }
+
+    for (i = n; i-- > 0;)
+    {
+        float* xi = &MAT(x, i, 0);
+        const float d = SYM(U, i, i);
+
+        for (j = i + 1; j < n; j++)
+            vec_axpy(xi, -SYM(U, i, j), &MAT(x, j, 0), c);
+        for (j = 0; j < c; j++)
+            xi[j] /= d;
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSymPrint                                                      *
+*                                                                               *
+* PURPOSE: Prints the whole symmetric matrix                                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* s         SymMatrix*   I      Pointer to the object                           *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+void vSymPrint(SymMatrix* s)
+{
+  if(s!=NULL){
+    size_t i;
+    size_t j;
+    for (i = 0; i < s->n; i++)
+    {
+        for (j = 0; j < s->n; j++)
+        {
+            printf("%f\t", (i <= j) ? SYM(s, i, j) : SYM(s, j, i));
+        }
+        printf("\n");
+    }
+  }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxDiagCreate                                                   *
+*                                                                               *
+* PURPOSE: Creates the object DiagMatrix, and then fills it with zeros          *
+*           returning the pointer to the created matrix                         *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* n         int          I      Number of rows and columns                      *
+*                                                                               *
+* RETURN VALUE: DiagMatrix*                                                     *
+********************************************************************************/
+
+DiagMatrix* pxDiagCreate(unsigned int n)
+{
+
+    DiagMatrix* d = (DiagMatrix*) malloc(sizeof(DiagMatrix));
+    if (d == NULL)
+    {
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(sizeof(DiagMatrix));
+
+    d->d = (float*) calloc(n ? n : 1, sizeof(float));
+    if (d->d == NULL)
+    {
+        HEAP_SUB(sizeof(DiagMatrix));
+        free(d);
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD((n ? n : 1) * sizeof(float));
+    d->n = n;
+
+    return d;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vDiagDestroy                                                   *
+*                                                                               *
+* PURPOSE: Destroys the Object                                                  *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* d         DiagMatrix*  I      Matrix to free                                  *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+
+void vDiagDestroy(DiagMatrix* d)
+{
+    if (d != NULL)
+    {
+        HEAP_SUB((d->n ? d->n : 1) * sizeof(float));
+        free(d->d);
+        HEAP_SUB(sizeof(DiagMatrix));
+        free(d);
+    }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iDiagGemm                                                      *
+*                                                                               *
+* PURPOSE: Computes C = alpha*D*B + beta*C, D being diagonal, that is row i     *
+*           of B scaled by D(i,i), O(r*c) instead of O(r*r*c).                  *
+*           C and B can be the same                                             *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* C         Matrix*      IO     Result, r x c                                   *
+* D         DiagMatrix*  I      Diagonal, r x r                                 *
+* B         Matrix*      I      r x c                                           *
+* alpha     float        I      Scale of the product                            *
+* beta      float        I      Scale of C, 0 to overwrite it                   *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iDiagGemm(Matrix* C, DiagMatrix* D, Matrix* B, float alpha, float beta)
+{
+    size_t i;
+    size_t j;
+    if (C == NULL || D == NULL || B == NULL)
+    {
+        return -1;
+    }
+    if ((B->r != D->n) || (C->r != B->r) || (C->c != B->c))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < C->r; i++)
+    {
+        const float a = alpha * D->d[i];
+        float*       c = &MAT(C, i, 0);
+        const float* b = &MAT(B, i, 0);
+
+        for (j = 0; j < C->c; j++)
+            c[j] = (beta == 0) ? a * b[j] : beta * c[j] + a * b[j];
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iSymDiagCongruence                                             *
+*                                                                               *
+* PURPOSE: Computes S = alpha*D*P*D + beta*S on packed triangles, D being       *
+*           diagonal, that is S(i,j) = beta*S(i,j) + alpha*D(i,i)*P(i,j)*D(j,j) *
+*           S and P can be the same                                             *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* S         SymMatrix*   IO     Result, n x n                                   *
+* D         DiagMatrix*  I      Diagonal, n x n                                 *
+* P         SymMatrix*   I      Symmetric matrix, n x n                         *
+* alpha     float        I      Scale of the congruence                         *
+* beta      float        I      Scale of S, 0 to overwrite it                   *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iSymDiagCongruence(SymMatrix* S, DiagMatrix* D, SymMatrix* P, float alpha, float beta)
+{
+    size_t i;
+    size_t j;
+    size_t n;
+    if (S == NULL || D == NULL || P == NULL)
+    {
+        return -1;
+    }
+    if ((D->n != S->n) || (P->n != S->n))
+    {
+        return -1;
+    }
+    n = S->n;
+
+    for (i = 0; i < n; i++)
+    {
+        const float  a = alpha * D->d[i];
+        float*       s = &SYM(S, i, i);
+        const float* p = &SYM(P, i, i);
+
+        for (j = i; j < n; j++)
+            s[j - i] = (beta == 0) ? a * p[j - i] * D->d[j] : beta * s[j - i] + a * p[j - i] * D->d[j];
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vDiagPrint                                                     *
+*                                                                               *
+* PURPOSE: Prints the whole diagonal matrix                                     *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* d         DiagMatrix*  I      Pointer to the object                           *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+void vDiagPrint(DiagMatrix* d)
+{
+  if(d!=NULL){
+    size_t i;
+    size_t j;
+    for (i = 0; i < d->n; i++)
+    {
+        for (j = 0; j < d->n; j++)
+        {
+            printf("%f\t", (i == j) ? d->d[i] : 0.0f);
+        }
+        printf("\n");
+    }
+  }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: blk_storage_size                                               *
+*                                                                               *
+* PURPOSE: Returns the size in bytes of the nb blocks of b x b of a block       *
+*           diagonal matrix, padded to MATRIX_ALIGN, never 0                    *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* b         int          I      Rows and columns of a block                     *
+* nb        int          I      Number of blocks                                *
+*                                                                               *
+* RETURN VALUE: size_t                                                          *
+********************************************************************************/
+static size_t blk_storage_size(unsigned int b, unsigned int nb)
+{
+    size_t elems = (size_t)nb * b * b * sizeof(float);
+
+    return (elems + MATRIX_ALIGN) & ~((size_t)MATRIX_ALIGN - 1);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxBlkDiagCreate                                                *
+*                                                                               *
+* PURPOSE: Creates the object BlkDiagMatrix of nb blocks of b x b, and then     *
+*           fills it with zeros returning the pointer to the created matrix.    *
+*           The blocks are stored one after the other in one MATRIX_ALIGN       *
+*           aligned block, element (i,j) of block k being BLK(m, k, i, j)       *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* b         int          I      Rows and columns of a block                     *
+* nb        int          I      Number of blocks                                *
+*                                                                               *
+* RETURN VALUE: BlkDiagMatrix*                                                  *
+********************************************************************************/
+
+BlkDiagMatrix* pxBlkDiagCreate(unsigned int b, unsigned int nb)
+{
+
+    size_t         size = blk_storage_size(b, nb);
+    void*          block;
+    BlkDiagMatrix* m = (BlkDiagMatrix*) malloc(sizeof(BlkDiagMatrix));
+    if (m == NULL)
+    {
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(sizeof(BlkDiagMatrix));
+
+    if (posix_memalign(&block, MATRIX_ALIGN, size) != 0)
+    {
+        HEAP_SUB(sizeof(BlkDiagMatrix));
+        free(m);
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(size);
+
+    m->data = (float*)block;
+    m->b    = b;
+    m->nb   = nb;
+    memset(m->data, 0, (size_t)nb * b * b * sizeof(float));
+
+    return m;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBlkDiagDestroy                                                *
+*                                                                               *
+* PURPOSE: Destroys the Object                                                  *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* m         BlkDiagMatrix* I      Matrix to free                                *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+
+void vBlkDiagDestroy(BlkDiagMatrix* m)
+{
+    if (m != NULL)
+    {
+        HEAP_SUB(blk_storage_size(m->b, m->nb));
+        free(m->data);
+        HEAP_SUB(sizeof(BlkDiagMatrix));
+        free(m);
+    }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iBlkDiagGemm                                                   *
+*                                                                               *
+* PURPOSE: Computes C = alpha*M*B + beta*C, M being block diagonal: each block   *
+*           only multiplies its own b rows of B, O(b*n*c) instead of O(n*n*c)   *
+*            returns -1 if failed, 0 if successfull                             *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* C         Matrix*        IO     Result, n x c, not the same as B              *
+* M         BlkDiagMatrix* I      Block diagonal, n x n, n = b*nb               *
+* B         Matrix*        I      n x c                                         *
+* alpha     float          I      Scale of the product                          *
+* beta      float          I      Scale of C, 0 to overwrite it                 *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iBlkDiagGemm(Matrix* C, BlkDiagMatrix* M, Matrix* B, float alpha, float beta)
+{
+    size_t k;
+    size_t i;
+    size_t j;
+    size_t b;
+    if (C == NULL || M == NULL || B == NULL || C == B)
+    {
+        return -1;
+    }
+    b = M->b;
+    if ((B->r != b * M->nb) || (C->r != B->r) || (C->c != B->c))
+    {
+        return -1;
+    }
+
+    for (k = 0; k < M->nb; k++)
+    {
+        for (i = 0; i < b; i++)
+        {
+            float* c = &MAT(C, k * b + i, 0);
+
+            if (beta == 0)
+                memset(c, 0, C->c * sizeof(float));
+            else if (beta != 1)
+            {
+                for (j = 0; j < C->c; j++)
+                    c[j] *= beta;
+            }
+
+            for (j = 0; j < b; j++)
+            {
+                const float a = alpha * BLK(M, k, i, j);
+                if (a == 0)
+                    continue;
+                vec_axpy(c, a, &MAT(B, k * b + j, 0), C->c);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vBlkDiagPrint                                                  *
+*                                                                               *
+* PURPOSE: Prints the blocks, one after the other                               *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type           IO     Description                                   *
+* --------- --------       --     ---------------------------------             *
+* m         BlkDiagMatrix* I      Pointer to the object                         *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+********************************************************************************/
+void vBlkDiagPrint(BlkDiagMatrix* m)
+{
+  if(m!=NULL){
+    size_t k;
+    size_t i;
+    size_t j;
+    for (k = 0; k < m->nb; k++)
+    {
+        for (i = 0; i < m->b; i++)
+        {
+            for (j = 0; j < m->b; j++)
+            {
+                printf("%f\t", BLK(m, k, i, j));
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+  }
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: sp_storage_size                                                *
+*                                                                               *
+* PURPOSE: Returns the size in bytes of the block holding a sparse matrix of    *
+*           r rows with room for cap elements: values, columns and row_ptr      *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* r         int          I      Number of rows                                  *
+* cap       int          I      Maximum number of stored elements               *
+*                                                                               *
+* RETURN VALUE: size_t                                                          *
+********************************************************************************/
+static size_t sp_storage_size(unsigned int r, unsigned int cap)
+{
+    return (size_t)cap * (sizeof(float) + sizeof(unsigned int)) + ((size_t)r + 1) * sizeof(unsigned int);
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pxSpCreate                                                     *
+*                                                                               *
+* PURPOSE: Creates the object SpMatrix with no stored elements, i.e. all        *
+*           zeros, and room for cap of them, see iSpInsert,                     *
+*           returning the pointer to the created matrix                         *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* r         int          I      Number of rows                                  *
+* c         int          I      Number of columns                               *
+* cap       int          I      Maximum number of stored elements               *
+*                                                                               *
+* RETURN VALUE: SpMatrix*                                                       *
+********************************************************************************/
+
+SpMatrix* pxSpCreate(unsigned int r, unsigned int c, unsigned int cap)
+{
+
+    size_t    size = sp_storage_size(r, cap);
+    char*     block;
+    SpMatrix* m = (SpMatrix*) malloc(sizeof(SpMatrix));
+    if (m == NULL)
+    {
+        perror("Error Create");
+        return NULL;
+    }
+    HEAP_ADD(sizeof(SpMatrix));
+
+    block = (char*) calloc(1, size);
+    if (block == NULL)
     {
-        for (j=0; j<m1->c; j++)
-            s->matrix[i][j]=m1->matrix[i][j]+m2->matrix[i][j];
+        HEAP_SUB(sizeof(SpMatrix));
+        free(m);
+        perror("Error Create");
+        return NULL;
     }
+    HEAP_ADD(size);
 
-    return 0;
+    m->val     = (float*)block;
+    m->col     = (unsigned int*)(block + (size_t)cap * sizeof(float));
+    m->row_ptr = &m->col[cap];
+    m->r       = r;
+    m->c       = c;
+    m->nnz     = 0;
+    m->cap     = cap;
+
+    return m;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: pxSum                                                          *
+* FUNCTION NAME: vSpDestroy                                                     *
 *                                                                               *
-* PURPOSE: Computes the sum of the matrices                                     *
+* PURPOSE: Destroys the Object                                                  *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* m2        Matrix*      I      Pointer to the 2nd object                       *
+* m         SpMatrix*    I      Matrix to free                                  *
 *                                                                               *
-* RETURN VALUE: Matrix*                                                    		*
+* RETURN VALUE: void                                                            *
 ********************************************************************************/
 
-Matrix* pxSum (Matrix* m1, Matrix* m2)
+void vSpDestroy(SpMatrix* m)
 {
-    Matrix* m3 = pxCreate(m1->c, m1->r);
-    int check = iSum(m3,m1,m2);
-    if(check<0)
+    if (m != NULL)
     {
-        vDestroy(m3);
-        return NULL;
+        HEAP_SUB(sp_storage_size(m->r, m->cap));
+        free(m->val);
+        HEAP_SUB(sizeof(SpMatrix));
+        free(m);
     }
-    else
-        return m3;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: iSubtract                                                      *
+* FUNCTION NAME: iSpInsert                                                      *
 *                                                                               *
-* PURPOSE: Computes the subtraction of the matrices                             *
-*           returning -1 if failed, 0 if successfull                            *
+* PURPOSE: Stores the element (i,j) = v. The elements have to be inserted       *
+*           row by row, by increasing column, so that the pattern is built      *
+*           once, the values being changed later through pxSpEntry              *
+*            returns -1 if failed, i.e. out of order or no room, 0 if           *
+*            successfull                                                        *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* m2        Matrix*      I      Pointer to the 2nd object                       *
-* s         Matrix*      O      Pointer to the subtract object                  *
+* m         SpMatrix*    IO     Pointer to the object                           *
+* i         int          I      Row of the element                              *
+* j         int          I      Column of the element                           *
+* v         float        I      Value of the element                            *
 *                                                                               *
 * RETURN VALUE: int                                                             *
 ********************************************************************************/
-int iSubtract(Matrix *s,Matrix* m1,Matrix* m2)
+int iSpInsert(SpMatrix* m, unsigned int i, unsigned int j, float v)
 {
-    if(m1==NULL || m2==NULL)
+    size_t t;
+    if (m == NULL)
     {
         return -1;
     }
-    if(m1->r != m2->r || m1->c != m2->c)
+    if ((i >= m->r) || (j >= m->c) || (m->nnz >= m->cap))
     {
         return -1;
     }
-    size_t i;
-    size_t j;
-    for (i=0; i<m1->r; i++)
+    /* No element in the rows after i, none at or after column j in row i */
+    if ((m->row_ptr[i + 1] != m->nnz) || ((m->row_ptr[i] != m->nnz) && (m->col[m->nnz - 1] >= j)))
     {
-        for (j=0; j<m1->c; j++)
-        {
-            s->matrix[i][j]=m1->matrix[i][j]-m2->matrix[i][j];
-        }
+        return -1;
     }
 
+    m->val[m->nnz] = v;
+    m->col[m->nnz] = j;
+    m->nnz++;
+    for (t = i + 1; t <= m->r; t++)
+        m->row_ptr[t] = m->nnz;
+
     return 0;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: pxSubtract                                                     *
+* FUNCTION NAME: pxSpEntry                                                      *
 *                                                                               *
-* PURPOSE: Computes the subtraction of the matrices                             *
+* PURPOSE: Returns the pointer to the stored element (i,j),                     *
+*           NULL if (i,j) is not stored, i.e. it is a structural zero           *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* m2        Matrix*      I      Pointer to the 2nd object                       *
+* m         SpMatrix*    I      Pointer to the object                           *
+* i         int          I      Row of the element                              *
+* j         int          I      Column of the element                           *
 *                                                                               *
-* RETURN VALUE: Matrix*                                                         *
+* RETURN VALUE: float*                                                          *
 ********************************************************************************/
-
-Matrix* pxSubtract(Matrix* m1, Matrix* m2)
+float* pxSpEntry(SpMatrix* m, unsigned int i, unsigned int j)
 {
-    Matrix* m3 = pxCreate(m1->r, m2->c);
-    int check = iSubtract(m3,m1,m2);
-    if(check<0)
+    size_t t;
+    if ((m == NULL) || (i >= m->r))
     {
-        vDestroy(m3);
         return NULL;
     }
-    else
-        return m3;
+
+    for (t = m->row_ptr[i]; t < m->row_ptr[i + 1]; t++)
+    {
+        if (m->col[t] == j)
+            return &m->val[t];
+    }
+
+    return NULL;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: iSc_multiply                                                   *
+* FUNCTION NAME: iSymSpCongruence                                               *
 *                                                                               *
-* PURPOSE: Multiplies the matrix to a scalar                                    *
-*           returning -1 if failed, 0 if successfull                            *
+* PURPOSE: Computes S = alpha*A*P*A' + beta*S on packed triangles, A being      *
+*           sparse: only the stored elements of A are visited, so forming       *
+*           W = A*P costs O(nnz*n) and the upper triangle of S O(nnz*m).        *
+*           P is only read to form W, S and P can be the same object            *
+*            returns -1 if failed, 0 if successfull                             *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* f         float        I      Multiplier                                      *
-* s         Matrix*      O      Pointer to the result object     	            *
+* S         SymMatrix*   IO     Result, m x m                                   *
+* A         SpMatrix*    I      m x n                                           *
+* P         SymMatrix*   I      Symmetric matrix, n x n                         *
+* alpha     float        I      Scale of the congruence                         *
+* beta      float        I      Scale of S, 0 to overwrite it                   *
+* W         Matrix*      O      Scratch object, A*P, m x n                      *
 *                                                                               *
 * RETURN VALUE: int                                                             *
 ********************************************************************************/
-int iSc_Multiply(Matrix *s, Matrix* m1, float f)
+int iSymSpCongruence(SymMatrix* S, SpMatrix* A, SymMatrix* P, float alpha, float beta, Matrix* W)
 {
-    if(m1==NULL)
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t l;
+    size_t p;
+    size_t t;
+    size_t m;
+    size_t n;
+    if (S == NULL || A == NULL || P == NULL || W == NULL)
     {
         return -1;
     }
-	if((s->c != m1->c) || (s->r != m1->r))
+    m = S->n;
+    n = P->n;
+    if ((A->r != m) || (A->c != n) || (W->r != m) || (W->c != n))
     {
-		return -1;
+        return -1;
     }
-    size_t i;
-    size_t j;
-    for (i = 0; i < m1->r; i++)
+
+    /* W(i,:) = sum_l A(i,l)*P(l,:), P(l,l..n-1) being row l of the packing, P(0..l-1,l) its column */
+    for (i = 0; i < m; i++)
+    {
+        float* w = &MAT(W, i, 0);
+        memset(w, 0, n * sizeof(float));
+        for (t = A->row_ptr[i]; t < A->row_ptr[i + 1]; t++)
+        {
+            const float a = A->val[t];
+            l = A->col[t];
+            vec_axpy(&w[l], a, &SYM(P, l, l), n - l);
+            for (k = 0, p = l; k < l; p += n - k - 1, k++)
+                w[k] += a * P->data[p];
+        }
+    }
+
+    /* Upper triangle only: S(i,j) = beta*S(i,j) + alpha*sum_k A(i,k)*W(j,k) */
+    for (i = 0; i < m; i++)
     {
-        for (j = 0; j < m1->c; j++)
+        float* s = &SYM(S, i, i);
+
+        if (beta == 0)
+            memset(s, 0, (m - i) * sizeof(float));
+        else if (beta != 1)
+        {
+            for (j = 0; j < m - i; j++)
+                s[j] *= beta;
+        }
+
+        for (t = A->row_ptr[i]; t < A->row_ptr[i + 1]; t++)
         {
-            s->matrix[i][j] = m1->matrix[i][j] * f;
+            const float a = alpha * A->val[t];
+            k = A->col[t];
+            for (j = i; j < m; j++)
+                s[j - i] += a * MAT(W, j, k);
         }
     }
 
     return 0;
 }
+
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: pxSc_Multiply                                                  *
+* FUNCTION NAME: iSymSpRowMult                                                  *
 *                                                                               *
-* PURPOSE: Multiplies the matrix to a scalar                                    *
+* PURPOSE: Computes w = P*A(i,:)', the row i of A being sparse: O(nnz*n).       *
+*           That is the column of P*A' of a single output                       *
+*            returns -1 if failed, 0 if successfull                             *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* f         float        I      Multiplier                                      *
+* w         Matrix*      O      Result, n x 1                                   *
+* A         SpMatrix*    I      m x n                                           *
+* i         unsigned int I      Row of A                                        *
+* P         SymMatrix*   I      Symmetric matrix, n x n                         *
 *                                                                               *
-* RETURN VALUE: Matrix*                                                         *
+* RETURN VALUE: int                                                             *
 ********************************************************************************/
-
-
-Matrix* pxSc_Multiply(Matrix* m, float f)
+int iSymSpRowMult(Matrix* w, SpMatrix* A, unsigned int i, SymMatrix* P)
 {
-    Matrix* m3 = pxCreate(m->r,m->c);
-    int check = iSc_Multiply(m3,m,f);
-    if(check<0)
+    size_t k;
+    size_t l;
+    size_t p;
+    size_t t;
+    size_t n;
+    if (w == NULL || A == NULL || P == NULL)
     {
-        vDestroy(m3);
-        return NULL;
+        return -1;
     }
-    else
-        return m3;
+    n = P->n;
+    if ((i >= A->r) || (A->c != n) || (w->r != n) || (w->c != 1))
+    {
+        return -1;
+    }
+
+    /* Same walk as W = A*P in iSymSpCongruence, w being contiguous */
+    memset(w->data, 0, n * sizeof(float));
+    for (t = A->row_ptr[i]; t < A->row_ptr[i + 1]; t++)
+    {
+        const float a = A->val[t];
+        l = A->col[t];
+        vec_axpy(&w->data[l], a, &SYM(P, l, l), n - l);
+        for (k = 0, p = l; k < l; p += n - k - 1, k++)
+            w->data[k] += a * P->data[p];
+    }
+
+    return 0;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: iEquals                                                        *
+* FUNCTION NAME: iSymRank1                                                      *
 *                                                                               *
-* PURPOSE: Compares the 2 matrices                                              *
+* PURPOSE: Computes S = S + alpha*v*v' on the packed upper triangle, O(n^2/2)   *
 *            returns -1 if failed, 0 if successfull                             *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object                       *
-* m2        Matrix*      I      Pointer to the 2nd object                       *
+* S         SymMatrix*   IO     Symmetric matrix, n x n                         *
+* v         Matrix*      I      n x 1                                           *
+* alpha     float        I      Scale of the update                             *
 *                                                                               *
 * RETURN VALUE: int                                                             *
 ********************************************************************************/
-int iEquals(Matrix* m1, Matrix* m2)
+int iSymRank1(SymMatrix* S, Matrix* v, float alpha)
 {
-    if(m1==NULL || m2==NULL)
+    size_t i;
+    size_t n;
+    if (S == NULL || v == NULL)
     {
         return -1;
     }
-    if(m1->r != m2->r || m1->c != m2->c)
+    n = S->n;
+    if ((v->r != n) || (v->c != 1))
     {
         return -1;
     }
-    size_t i;
-    size_t j;
-    for (i=0; i<m1->r; i++)
+
+    /* Row i of the packing is S(i,i..n-1), updated by alpha*v(i)*v(i..n-1) */
+    for (i = 0; i < n; i++)
     {
-        for (j=0; j<m1->c; j++)
-        {
-            if(m1->matrix[i][j]!=m2->matrix[i][j])
-                return 0;
-        }
+        if (v->data[i] != 0)
+            vec_axpy(&SYM(S, i, i), alpha * v->data[i], &v->data[i], n - i);
     }
 
-    return 1;
+    return 0;
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: iMultiply                                                      *
+* FUNCTION NAME: vSpPrint                                                       *
 *                                                                               *
-* PURPOSE: Multiplies the 2 matrices                                            *
-*            returns -1 if failed, 0 if successfull                             *
+* PURPOSE: Prints the whole sparse matrix                                       *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object to multiply           *
-* m2        Matrix*      I      Pointer to the 2nd object to multiply           *
-* product   Matrix*      O      Pointer to the product object					*
-*					                                                            *
-* RETURN VALUE: int 	                                                        *
+* m         SpMatrix*    I      Pointer to the object                           *
+*                                                                               *
+* RETURN VALUE: void                                                            *
 ********************************************************************************/
-int iMultiply(Matrix* product,Matrix *m1, Matrix *m2)
+void vSpPrint(SpMatrix* m)
 {
-
+  if(m!=NULL){
     size_t i;
     size_t j;
-    size_t k;
-    if (m1 == NULL || m2 == NULL)
-    {
-        return -1;
-    }
-    if(m1->c != m2->r)
-    {
-        return -1;
-    }
-    if((m1->r!=product->r) || (m2->c!=product->c))
-    {
-    	return -1;
-    }
-
-    for (i = 0; i < m1->r; ++i)
+    size_t t;
+    for (i = 0; i < m->r; i++)
     {
-        for (j = 0; j < m2->c; ++j)
+        t = m->row_ptr[i];
+        for (j = 0; j < m->c; j++)
         {
-            for (k = 0; k < m1->c; ++k)
-            {
-                product->matrix[i][j] += m1->matrix[i][k] * m2->matrix[k][j];
-            }
+            if ((t < m->row_ptr[i + 1]) && (m->col[t] == j))
+                printf("%f\t", m->val[t++]);
+            else
+                printf("%f\t", 0.0f);
         }
+        printf("\n");
     }
-    return 0;
+  }
 }
 
 /********************************************************************************
 *                                                                               *
-* FUNCTION NAME: pxMultiply                                                     *
+* FUNCTION NAME: iCovPropagate                                                  *
 *                                                                               *
-* PURPOSE: Multiplies the 2 matrices                                            *
+* PURPOSE: Covariance propagation P = F*P*F' + G*Q*G' in one pass, in place,    *
+*           for a diagonal F, a sparse G and a symmetric Q.                     *
+*           Only the stored elements of G are visited and only the packed       *
+*           upper triangle of P is computed, no transpose is formed             *
+*            returns -1 if failed, 0 if successfull                             *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* m1        Matrix*      I      Pointer to the 1st object to multiply           *
-* m2        Matrix*      I      Pointer to the 2nd object to multiply           *
-*					                                                            *
-* RETURN VALUE: Matrix*                                                         *
+* P         SymMatrix*   IO     Covariance, n x n                               *
+* F         DiagMatrix*  I      State transition, n x n                         *
+* G         SpMatrix*    I      Input matrix, n x m                             *
+* Q         Matrix*      I      Input covariance, symmetric, m x m              *
+* W         Matrix*      O      Scratch object for G*Q, n x m                   *
+*                                                                               *
+* RETURN VALUE: int                                                             *
 ********************************************************************************/
-
-Matrix*  pxMultiply (Matrix* m1, Matrix* m2)
+int iCovPropagate(SymMatrix* P, DiagMatrix* F, SpMatrix* G, Matrix* Q, Matrix* W)
 {
 
-    Matrix* m3 = pxCreate(m1->r, m2->c);
-    int check = iMultiply(m3,m1,m2);
-    if(check<0)
+    size_t a;
+    size_t b;
+    size_t k;
+    size_t t;
+    size_t n;
+    size_t m;
+    if (P == NULL || F == NULL || G == NULL || Q == NULL || W == NULL)
     {
-        vDestroy(m3);
-        return NULL;
+        return -1;
     }
-    else
-        return m3;
+    n = P->n;
+    m = Q->r;
+    if ((F->n != n) || (G->r != n) || (G->c != m) || (Q->c != m))
+    {
+        return -1;
+    }
+    if ((W->r != n) || (W->c != m))
+    {
+        return -1;
+    }
+
+    /* W = G*Q, rows of Q only added for the stored elements of G */
+    for (a = 0; a < n; a++)
+    {
+        float* w = &MAT(W, a, 0);
+        memset(w, 0, m * sizeof(float));
+        for (t = G->row_ptr[a]; t < G->row_ptr[a + 1]; t++)
+            vec_axpy(w, G->val[t], &MAT(Q, G->col[t], 0), m);
+    }
+
+    /* Upper triangle: P(a,b) = F(a,a)*P(a,b)*F(b,b) + sum_k G(a,k)*W(b,k), W*G' being symmetric */
+    for (a = 0; a < n; a++)
+    {
+        float* p  = &SYM(P, a, a);
+        float  fa = F->d[a];
+
+        for (b = a; b < n; b++)
+            p[b - a] = fa * p[b - a] * F->d[b];
+
+        for (t = G->row_ptr[a]; t < G->row_ptr[a + 1]; t++)
+        {
+            const float g = G->val[t];
+            k = G->col[t];
+            for (b = a; b < n; b++)
+                p[b - a] += g * MAT(W, b, k);
+        }
+    }
+
+    return 0;
 }
 
 /********************************************************************************
@@ -761,7 +2465,7 @@ int iTranspose(Matrix *t, Matrix* m)
     for (i=0; i<t->r; i++)
     {
         for (j=0; j<t->c; j++)
-            t->matrix[i][j]=m->matrix[j][i];
+            MAT(t, i, j)=MAT(m, j, i);
     }
 
     return 0;
@@ -821,7 +2525,7 @@ int iIdentity(Matrix* m)
     for (i=0; i<m->r; i++)
     {
         for (j=0; j<m->c; j++)
-            m->matrix[i][j]=(i==j);
+            MAT(m, i, j)=(i==j);
     }
 
     return 0;
@@ -895,8 +2599,8 @@ float fDeterminant(Matrix* m)
         float sum2=0;
         for (j=0; j<m->r-i; j++)
         {
-            sum1*=L->matrix[i][j];
-            sum2*=U->matrix[i][j];
+            sum1*=MAT(L, i, j);
+            sum2*=MAT(U, i, j);
         }
         detL+=sum1;
         detU+=sum2;
@@ -943,22 +2647,22 @@ int iLU(Matrix* m, Matrix* L, Matrix* U)
 
             //sum of Lij*Ujk
             for (j=0; j<i; j++)
-                sum+=(L->matrix[i][j]*U->matrix[j][k]);
+                sum+=(MAT(L, i, j)*MAT(U, j, k));
 
-            U->matrix[i][k]=m->matrix[i][k]-sum;
+            MAT(U, i, k)=MAT(m, i, k)-sum;
         }
         for(k=i;k<m->r;k++)
         {
             if(i==k)
-                L->matrix[i][i]=1;
+                MAT(L, i, i)=1;
 
             else
             {
                 int sum=0;
                 for (j=0;j<i;j++)
-                    sum+=(L->matrix[k][i]*U->matrix[j][i]);
+                    sum+=(MAT(L, k, i)*MAT(U, j, i));
 
-                L->matrix[k][i]=(m->matrix[k][i]-sum/U->matrix[i][i]);
+                MAT(L, k, i)=(MAT(m, k, i)-sum/MAT(U, i, i));
             }
         }
     }
@@ -997,11 +2701,11 @@ int iEigenvalues(float* values, Matrix *m)
     {
         for(j = i + 1; j < r->c; j++)
         {
-            if(r->matrix[i][i] == 0)
+            if(MAT(r, i, i) == 0)
             {
                 for(l = i+1; l < r->c; l++)
                 {
-                    if(r->matrix[l][l] != 0)
+                    if(MAT(r, l, l) != 0)
                     {
                         iRowSwap(r, i, l);
                         break;
@@ -1009,12 +2713,12 @@ int iEigenvalues(float* values, Matrix *m)
                 }
                 continue;
             }
-            factor = r->matrix[i][j]/(r->matrix[i][i]);
+            factor = MAT(r, i, j)/(MAT(r, i, i));
             iReduce(r, i, j, factor);
         }
     }
     for(i = 0; i < r->r; i++)
-        values[i] = r->matrix[i][i];
+        values[i] = MAT(r, i, i);
 	iDestroy(r);
     return 0;
 }*/
@@ -1040,11 +2744,11 @@ int iEigenvalues(Vector* values, Matrix *m)
     {
         for(j = i + 1; j < r->c; j++)
         {
-            if(r->matrix[i][i] == 0)
+            if(MAT(r, i, i) == 0)
             {
                 for(l = i+1; l < r->c; l++)
                 {
-                    if(r->matrix[l][l] != 0)
+                    if(MAT(r, l, l) != 0)
                     {
                         iRowSwap(r, i, l);
                         break;
@@ -1052,13 +2756,13 @@ int iEigenvalues(Vector* values, Matrix *m)
                 }
                 continue;
             }
-            factor = r->matrix[i][j]/(r->matrix[i][i]);
+            factor = MAT(r, i, j)/(MAT(r, i, i));
             iReduce(r, i, j, factor);
         }
     }
     for(i = 0; i < r->r; i++)
     {
-        values->vector[i] = r->matrix[i][i];
+        values->vector[i] = MAT(r, i, i);
     }
     vDestroy(r);
     return 0;
@@ -1088,7 +2792,7 @@ void vPrint(Matrix* m)
     {
         for (j = 0; j < m->c; j++)
         {
-            printf("%f\t", m->matrix[i][j]);
+            printf("%f\t", MAT(m, i, j));
         }
         printf("\n");
     }
@@ -1189,13 +2893,7 @@ int iCopy(Matrix *c, Matrix* m)
 	{
     	return -1;
     }
-    size_t i;
-    size_t j;
-    for (i=0; i<m->r; i++)
-    {
-        for (j=0; j<m->c; j++)
-            c->matrix[i][j] = m->matrix[i][j];
-    }
+    memcpy(c->data, m->data, (size_t)m->r * m->c * sizeof(float));
 
     return 0;
 }
@@ -1260,9 +2958,9 @@ int iRowSwap(Matrix* m, unsigned int a, unsigned int b)
     }
     for(i = 0; i < m->r; i++)
     {
-        temp = m->matrix[i][a];
-        m->matrix[i][a] = m->matrix[i][b];
-        m->matrix[i][b] = temp;
+        temp = MAT(m, i, a);
+        MAT(m, i, a) = MAT(m, i, b);
+        MAT(m, i, b) = temp;
     }
     return 0;
 }
@@ -1297,7 +2995,7 @@ int iReduce(Matrix* m, unsigned int a, unsigned int b,float f)
     }
     for(i = 0; i < m->r; i++)
     {
-        m->matrix[i][b]  -= m->matrix[i][a]*f;
+        MAT(m, i, b)  -= MAT(m, i, a)*f;
     }
     return 0;
 }
@@ -1306,8 +3004,11 @@ int iReduce(Matrix* m, unsigned int a, unsigned int b,float f)
 *                                                                               *
 * FUNCTION NAME: iChol                                                          *
 *                                                                               *
-* PURPOSE: Computes the Cholesky factorization of the matrix                    *
-*           returning -1 if failed, 0 if successfull                            *
+* PURPOSE: Computes the Cholesky factorization m = L*L' of a symmetric          *
+*           positive definite matrix, L being lower triangular.                 *
+*           Only the lower triangle of m is read, m and L can be the same       *
+*           returning -1 if failed, i.e. m is not positive definite,            *
+*           0 if successfull                                                    *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
@@ -1324,7 +3025,7 @@ int iChol(Matrix* L, Matrix* m)
     {
         return -1;
     }
-    if((L->r != m->r) || (L->c != m->c))
+    if((L->r != m->r) || (L->c != m->c) || (m->r != m->c))
 	{
     	    return -1;
     }
@@ -1335,12 +3036,81 @@ int iChol(Matrix* L, Matrix* m)
     {
         for (j = 0; j < (i + 1); j++)
         {
-            float s = 0;
+            float s = MAT(m, i, j);
+            for (k = 0; k < j; k++)
+                s -= MAT(L, i, k) * MAT(L, j, k);
+
+            if (i == j)
+            {
+                /* Not positive definite, also catches NaN */
+                if (!(s > 0))
+                    return -1;
+                MAT(L, i, i) = sqrtf(s);
+            }
+            else
+                MAT(L, i, j) = s / MAT(L, j, j);
+        }
+
+        for (j = i + 1; j < L->c; j++)
+            MAT(L, i, j) = 0;
+    }
+
+    return 0;
+}
+
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: iCholSolve                                                     *
+*                                                                               *
+* PURPOSE: Computes x = b*S^-1 given the Cholesky factor L of S (see iChol),    *
+*           without forming the inverse: each row of x solves                   *
+*           L*y = b' by forward substitution and L'*x' = y by back              *
+*           substitution. x and b can be the same                               *
+*           returning -1 if failed, 0 if successfull                            *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* x         Matrix*      O      Pointer to the result object, r x n             *
+* L         Matrix*      I      Cholesky factor of S, n x n                     *
+* b         Matrix*      I      Pointer to the object, r x n                    *
+*                                                                               *
+* RETURN VALUE: int                                                             *
+********************************************************************************/
+int iCholSolve(Matrix* x, Matrix* L, Matrix* b)
+{
+    if (x == NULL || L == NULL || b == NULL)
+    {
+        return -1;
+    }
+    if ((L->r != L->c) || (b->c != L->r) || (x->r != b->r) || (x->c != b->c))
+    {
+        return -1;
+    }
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t n = L->r;
+    for (i = 0; i < x->r; i++)
+    {
+        float* xr = &MAT(x, i, 0);
+
+        if (x != b)
+            memcpy(xr, &MAT(b, i, 0), n * sizeof(float));
+
+        for (j = 0; j < n; j++)
+        {
             for (k = 0; k < j; k++)
-                s += L->matrix[i][k] * L->matrix[j][k];
-            L->matrix[i][j] = (i == j) ?
-                sqrt((m->matrix[i][i]) - s) :
-                (1.0 / L->matrix[j][j] * (m->matrix[i][j] - s));
+                xr[j] -= MAT(L, j, k) * xr[k];
+            xr[j] /= MAT(L, j, j);
+        }
+
+        for (j = n; j-- > 0;)
+        {
+            for (k = j + 1; k < n; k++)
+                xr[j] -= MAT(L, k, j) * xr[k];
+            xr[j] /= MAT(L, j, j);
         }
     }
 
@@ -1403,11 +3173,10 @@ int iSqrtm(Matrix *a, Matrix* m)
     	return -1;
     }
     size_t i;
-    size_t j;
-    for (i=0; i<m->r; i++)
+    size_t n = (size_t)m->r * m->c;
+    for (i=0; i<n; i++)
     {
-        for (j=0; j<m->c; j++)
-            a->matrix[i][j]=sqrt(m->matrix[i][j]);
+        a->data[i]=sqrt(m->data[i]);
     }
 
     return 0;
@@ -1472,13 +3241,10 @@ int iExpm(Matrix* a,Matrix* m,float e)
     	return -1;
     }
     size_t i;
-    size_t j;
-    for (i=0; i<m->r; i++)
+    size_t n = (size_t)m->r * m->c;
+    for (i=0; i<n; i++)
     {
-        for (j=0; j<m->c; j++)
-        {
-            a->matrix[i][j]=pow(m->matrix[i][j],e);
-        }
+        a->data[i]=pow(m->data[i],e);
     }
 
     return 0;
@@ -1546,7 +3312,7 @@ static int row_scalar_multiply(Matrix *m, unsigned int row, float factor)
     }
     for(i = 0; i < m->r; i++)
     {
-        m->matrix[i][row] *= factor;
+        MAT(m, i, row) *= factor;
     }
     return 0;
 }
@@ -1587,15 +3353,15 @@ int iBlkdiag(Matrix*m, Matrix* m1,Matrix* m2,Matrix* m3)
         {
             if(j<m1->c && i<m1->r)
             {
-                m->matrix[i][j]=m1->matrix[i][j];
+                MAT(m, i, j)=MAT(m1, i, j);
             }
             else if(j<(m1->c+m2->c) && i<(m1->r+m2->r) && j>=m1->c && i>=m1->r)
             {
-                m->matrix[i][j]=m2->matrix[i-(m1->r)][j-(m1->c)];
+                MAT(m, i, j)=MAT(m2, i-(m1->r), j-(m1->c));
             }
             else if(j<(m1->c+m2->c+m3->c) && i<(m1->r+m2->r+m3->r) && j>=(m1->c+m2->c) && i>=(m1->r+m2->r))
             {
-                m->matrix[i][j]=m3->matrix[i-(m1->r+m2->r)][j-(m1->c+m2->c)];
+                MAT(m, i, j)=MAT(m3, i-(m1->r+m2->r), j-(m1->c+m2->c));
             }
         }
     }
@@ -1665,7 +3431,7 @@ int iDiag(Matrix*d, Matrix* m)
     size_t i;
     for (i=0; i<m->r; i++)
     {
-        d->matrix[i][i]=m->matrix[i][0];
+        MAT(d, i, i)=MAT(m, i, 0);
     }
     return 0;
 }
@@ -1769,7 +3535,7 @@ float* pxCsvToFloat(const char* path, int* dim)
     }
 	 *dim = n+1;
     val = malloc(*dim*sizeof(*dim));
-    heap_usage += *dim*sizeof(*dim);
+    HEAP_ADD(*dim*sizeof(*dim));
     while (fscanf(myFile, "%f", &val[i++]) == 1)
     {
         fscanf(myFile, ",");
@@ -1850,6 +3616,6 @@ float fRandn()
 int uGetHeapUsage()
 {
 
-    return heap_usage;
+    return __atomic_load_n(&heap_usage, __ATOMIC_RELAXED);
 
 }
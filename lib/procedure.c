@@ -47,7 +47,9 @@
 *   ----     ----       ---      -----------                                                        *
 *   current  float[][]           Current of cells                                                   *
 *   voltage  float[][]           Voltage of cells                                                   *
-*   Temp     int                 Temperature of cells                                               *
+*   Temp     float[]             Temperature of cells                                               *
+*   t_sample struct timespec     Time of the last samples                                           *
+*   n_pred   int                 Predictions since the last update                                  *
 *                                                                                                   *
 * EXTERNAL REFERENCES:                                                                              *
 *                                                                                                   *
@@ -70,6 +72,16 @@
 *   ----          ------            ---------     ------      ----------------------                *
 *   28-12-2020    N.di Gruttola                    1          V1 Created					        * 
 *                  Giardino																		    *
+*   17-10-2026    agent                            2          Temperature of every cell given to    *
+*                                                              the EKF                              *
+*   17-10-2026    agent                            3          Measured time between the samples     *
+*                                                              given to the EKF                     *
+*   17-10-2026    agent                            4          Voltage update every EKF_UPDATE_DIV   *
+*                                                              predictions                          *
+*   17-10-2026    agent                            5          Voltage of group NoOfCell / PAR,      *
+*                                                              inputs of the lumped groups          *
+*   17-10-2026    agent                            6          SOH thread, fed by the Kalman thread  *
+*                                                              (EKF_SOH)                            *
 *                                                                                                   *
 *                                                                                                   *
 *                                                                                                   *
@@ -81,9 +93,25 @@
 
 static float current [PAR * SER];
 static float voltage [SER];
-static int Temp      [PAR * SER];
+static float Temp    [PAR * SER];
+static struct timespec t_sample;
+static int n_pred;
+
+#if EKF_LUMP_PAR
+/* Inputs of the lumped cells, see vLumpGroups */
+static float current_grp [N_CELLS];
+static float Temp_grp    [N_CELLS];
+#define EKF_CURRENT current_grp
+#define EKF_TEMP    Temp_grp
+#else
+#define EKF_CURRENT current
+#define EKF_TEMP    Temp
+#endif
 
 static int iSearch_Min(float[], int);
+#if EKF_LUMP_PAR
+static void vLumpGroups(void);
+#endif
 
 /* Sets state of exit_threads to 1, closing threads and shutting down the program */
 void vKill_handler() { exit_threads = 1; }
@@ -183,7 +211,7 @@ void vKalmanLoop(Kalman* k, int s)
             {
                 data.u16[0] = frame.data[VOLT1];
                 data.u16[1] = frame.data[VOLT2];
-                voltage[NoOfCell % PAR] = data.f;
+                voltage[NoOfCell / PAR] = data.f;
             }
 
             dataint.u16[0] = frame.data[TMP1];
@@ -193,7 +221,7 @@ void vKalmanLoop(Kalman* k, int s)
     }
 
 #if DEBUG2
-    printf("Frame data: %f %f %d\n", current[0], voltage[0], Temp[0]);
+    printf("Frame data: %f %f %f\n", current[0], voltage[0], Temp[0]);
 #endif
 
 
@@ -201,32 +229,45 @@ void vKalmanLoop(Kalman* k, int s)
     printf("EKF\n");
 #endif
 
-    vEKF_Step1(k, current, Temp[0]);
-    vEKF_Step2(k, voltage, Temp[0]);
+    /* The step is the time between the samples, not the nominal period */
+#if EKF_LUMP_PAR
+    vLumpGroups();
+#endif
+
+    vEKF_Step1(k, EKF_CURRENT, EKF_TEMP, fRt_elapsed(&t_sample));
+
+    /* The voltage update only every EKF_UPDATE_DIV predictions */
+    if (++n_pred >= EKF_UPDATE_DIV)
+    {
+        vEKF_Step2(k, voltage, EKF_TEMP);
+        n_pred = 0;
+    }
     
 #if DEBUG_PRINTSOC
-    printf("The soc is: %f.2%%\n", k->x->matrix[Z_IND][0] * 100);
+    printf("The soc is: %f.2%%\n", fGetSOC(k, 0) * 100);
 #endif
 
 #if RASPI_SOC
     /* Calculating mean SoC and mean Temperature*/
     float val[2] = {0, 0};
 
+    for (i = 0; i < N_CELLS; i++)
+        val[0] += fGetSOC(k, i);
+    val[0] /= N_CELLS;
     for (i = 0; i < PAR * SER; i++)
-        val[0] += k->x->matrix[Z_IND + i][0];
-    val[0] /= (PAR * SER);
-    for (i = 0; i < PAR * SER; i++)
-        val[1] += (float)Temp[i];
+        val[1] += Temp[i];
     val[1] /= (PAR * SER);
     vPrintLCD(val);
 #endif
 
-    index = iSearch_Min(k->x->matrix[Z_IND], k->x->c);
+    /* The SOCs of the cells are contiguous in the state vector */
+    index = iSearch_Min(k->x->matrix[Z_IND], N_CELLS);
 
-    for (i = 0; i < k->x->c; i++)
+    for (i = 0; i < N_CELLS; i++)
     {
-        if (k->x->matrix[Z_IND][i] >= (k->x->matrix[Z_IND][index] + SOC_RANGE))
-            soc = soc | (2 ^ i);
+        /* The bits of all the LUMP cells of the modelled cell, i * LUMP < 64 as PAR * SER <= 64 */
+        if (fGetSOC(k, i) >= (fGetSOC(k, index) + SOC_RANGE))
+            soc = soc | ((~0ULL >> (64 - LUMP)) << (i * LUMP));
     }
 
 #if DEBUG
@@ -275,6 +316,33 @@ void vEndLoop(int s)
 }
 
 
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vSohLoop                                                       *
+*                                                                               *
+* PURPOSE: Runs the SOH estimator on the samples of the Kalman thread           *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* h         Soh*         IO     Soh structure                                   *
+*                                                                               *
+* RETURN VALUE: NULL                                                            *
+*                                                                               *
+********************************************************************************/
+
+void vSohLoop(Soh* h)
+{
+
+    vSohUpdate(h);
+
+#if DEBUG_PRINTSOC
+    printf("The capacity is: %f.2%% of the nominal\n", fGetSOH(h, 0) * 100);
+#endif
+
+}
+
 /********************************************************************************
 *                                                                               *
 * FUNCTION NAME: pvKalmanThread                                                 *
@@ -310,6 +378,7 @@ void* pvKalmanThread(void* ktof)
     * index         int                     Index of value to be stored
     * pinfo         struct period_info      Struct containing periodic thread informations on time
     * passed_ms     struct timespec         Struct containing the ms passed between init of the Kalman step and finish
+    * heap          int                     Bytes in heap after vSetup, the Kalman Loop must not change it
     */
 
     struct KalmanForThread *kf = (struct KalmanForThread *)ktof;
@@ -327,14 +396,10 @@ void* pvKalmanThread(void* ktof)
     size_t i;
     float val[2];
     size_t index = 1;
+    int heap;
 
-#if RASPI_SOC
-    /* Setting a 1s period */
-    pinfo.period_ns = 1 * NS_PER_SEC;
-#else
-    /* Setting a 15ms period */
-    pinfo.period_ns = 15 * NS_PER_MS;
-#endif
+    /* 1s on the Raspberry, 15ms else, see procedure.h */
+    pinfo.period_ns = KALMAN_PERIOD_NS;
 
     vPeriodic_task_init(&pinfo);
 
@@ -396,7 +461,7 @@ void* pvKalmanThread(void* ktof)
             {
                 data.u16[0] = frame.data[VOLT1];
                 data.u16[1] = frame.data[VOLT2];
-                voltage[NoOfCell % PAR] = data.f;
+                voltage[NoOfCell / PAR] = data.f;
             }
 
             dataint.u16[0] = frame.data[TMP1];
@@ -407,11 +472,19 @@ void* pvKalmanThread(void* ktof)
 
     /* Setup KF TBD */
     printf("Setting up EKF\n");
-    vSetup(&kf->k, Temp[0], voltage);
+#if EKF_LUMP_PAR
+    vLumpGroups();
+#endif
+    vSetup(&kf->k, EKF_TEMP, voltage, NULL);
+#if EKF_SOH
+    vSohSetup(&kf->soh, &kf->k);
+#endif
+    fRt_elapsed(&t_sample);
+    heap = uGetHeapUsage();
 
     /* Store variables */
-    val[0] = kf->k.x->matrix[Z_IND][0];
-    val[1] = kf->k.Pk->matrix[Z_IND][Z_IND];
+    val[0] = fGetSOC(&kf->k, 0);
+    val[1] = fGetSOCVar(&kf->k, 0);
     vInitLogger(val);
 
     /* Wait period */
@@ -428,9 +501,17 @@ void* pvKalmanThread(void* ktof)
         /* Compute Kalman Loop */
         vKalmanLoop(&kf->k, s);
 
+#if EKF_SOH
+        /* Never waits for the SOH thread */
+        vSohFeed(&kf->soh, &kf->k, voltage);
+#endif
+
+        /* The EKF steps only use the workspace allocated by vSetup */
+        c_assert(uGetHeapUsage() == heap);
+
         /* Store variables */
-        val[0] = kf->k.x->matrix[Z_IND][0];
-        val[1] = kf->k.Pk->matrix[Z_IND][Z_IND];
+        val[0] = fGetSOC(&kf->k, 0);
+        val[1] = fGetSOCVar(&kf->k, 0);
         vStoreData(val, index);
         index++;
 
@@ -491,17 +572,68 @@ void *pvEndThread()
 }
 
 
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: pvSohThread                                                    *
+*                                                                               *
+* PURPOSE: This thread runs the SOH estimator at a low priority, the Kalman     *
+*               thread giving it its samples through a lock-free queue          *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+* ktof      void*        IO     Input to the thread                             *
+*                                                                               *
+* RETURN VALUE: NULL                                                            *
+*                                                                               *
+********************************************************************************/
+
+void* pvSohThread(void* ktof)
+{
+    /* LOCAL VARIABLES:
+    * Variable      Type           	        Description
+    * ------------- -------        	        ---------------
+    * kf            struct KalmanForThread	Struct of the Kalman structure + threads
+    * pinfo         struct period_info      Struct containing periodic thread informations on time
+    * passed_ms     struct timespec         Struct containing the ms passed in the SOH step
+    */
+
+    struct KalmanForThread *kf = (struct KalmanForThread *)ktof;
+
+    struct period_info pinfo;
+    struct timespec    passed_ms;
+
+    pinfo.period_ns = SOH_PERIOD_NS;
+
+    vPeriodic_task_init(&pinfo);
+
+    while(!iGetExit())
+    {
+
+        passed_ms.tv_nsec = lRt_gettime();
+
+        vSohLoop(&kf->soh);
+
+        passed_ms.tv_nsec = lRt_gettime() - passed_ms.tv_nsec;
+        vWait_rest_of_period(&pinfo, &passed_ms);
+
+    }
+
+    pthread_exit(NULL);
+
+}
+
 /********************************************************************************
 *                                                                               *
 * FUNCTION NAME: iSearch_Min                                                    *
 *                                                                               *
-* PURPOSE: Search the min in an array                                           *
+* PURPOSE: Search the min in an array, returns its index                        *
 *                                                                               *
 * ARGUMENT LIST:                                                                *
 *                                                                               *
 * Argument  Type         IO     Description                                     *
 * --------- --------     --     ---------------------------------               *
-* arr       int[]        I       Array of ints                                  *
+* arr       float[]      I       Array of floats                                *
 * n         int          I       No. of numbers                                 *
 *                                                                               *
 * RETURN VALUE: int                                                             *
@@ -514,36 +646,70 @@ static int iSearch_Min(float arr[], int n)
     * Variable      Type      Description
     * ------------- -------   ---------------
     * i             int       Loop counter 
-    * min		    float     Minimum number
+    * min		    int       Index of the minimum
     */
 
-    float min;
+    int min;
     int i;
 
-    if (n == 1)
-    {
-        min = arr[0];
-        return 0;
-    }
+    min = 0;
 
-    if (arr[0] > arr[1])
+    for (i = 1; i < n; i++)
     {
-        min = arr[1];
-    }
-    else
-    {
-        min = arr[0];
+        if (arr[i] < arr[min])
+            min = i;
     }
 
-    for (i = 2; i < n; i++)
+    return min;
+
+}
+
+#if EKF_LUMP_PAR
+/********************************************************************************
+*                                                                               *
+* FUNCTION NAME: vLumpGroups                                                    *
+*                                                                               *
+* PURPOSE: Computes the inputs of the lumped cells from the received ones:      *
+*           the current of a group is the sum of the currents of its            *
+*           PAR cells, its temperature their mean                               *
+*                                                                               *
+* ARGUMENT LIST:                                                                *
+*                                                                               *
+* Argument  Type         IO     Description                                     *
+* --------- --------     --     ---------------------------------               *
+*                                                                               *
+* RETURN VALUE: void                                                            *
+*                                                                               *
+********************************************************************************/
+
+static void vLumpGroups(void)
+{
+    /* LOCAL VARIABLES:
+    * Variable      Type      Description
+    * ------------- -------   ---------------
+    * i             int       Group
+    * j             int       Cell of the group
+    */
+
+    int i;
+    int j;
+
+    for (i = 0; i < N_CELLS; i++)
     {
-        if (arr[i] < min)
-            min = arr[i];
-    }
+        current_grp[i] = 0;
+        Temp_grp[i]    = 0;
 
-    return i;
+        for (j = 0; j < PAR; j++)
+        {
+            current_grp[i] += current[i * PAR + j];
+            Temp_grp[i]    += Temp[i * PAR + j];
+        }
+
+        Temp_grp[i] /= PAR;
+    }
 
 }
+#endif
 
 #if RASPI_SOC
 
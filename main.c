@@ -76,6 +76,7 @@
 *                                                              MISRA-C:2004                                                             *
 *   28-12-2020    N.di Gruttola                    1          V1 Created					                                            *
 *                  Giardino																		                                        *
+*   17-10-2026    agent                            2          SOH estimator thread (EKF_SOH)                                            *
 *                                                                                                                                       *
 * ALGORITHM (PDL)                                                                                                                       *
 *                                                                                                                                       *
@@ -117,7 +118,7 @@ int main(int argc, char* argv[])
 
     signal(SIGINT, vKill_handler);
 
-    struct KalmanForThread *kf = (struct KalmanForThread *)malloc(sizeof(struct KalmanForThread));
+    struct KalmanForThread *kf = (struct KalmanForThread *)calloc(1, sizeof(struct KalmanForThread));
 
     FILE* myFile;
     int n = 0, j = 0;
@@ -265,12 +266,24 @@ int main(int argc, char* argv[])
     kf->thread[END].priority        = 75;
     kf->thread[END].func            = pvEndThread;
 
+#if EKF_SOH
+    /* Below every real-time thread, it only has to keep up with the queue */
+    kf->thread[SOH_EST].type        = 0;
+    kf->thread[SOH_EST].policy      = SCHED_OTHER;
+    kf->thread[SOH_EST].priority    = 0;
+    kf->thread[SOH_EST].func        = pvSohThread;
+    kf->thread[SOH_EST].args        = (void*)kf;
+#endif
+
     /* Lock memory */
     SAFE_PFUNC(mlockall(MCL_CURRENT | MCL_FUTURE));
 
     /* Create pthread */
     SAFE_PFUNC(iCreate_thread(&kf->thread[KALMAN]));
     SAFE_PFUNC(iCreate_thread(&kf->thread[END]));
+#if EKF_SOH
+    SAFE_PFUNC(iCreate_thread(&kf->thread[SOH_EST]));
+#endif
 
     for (size_t i = 1; i < NTHREADS; i++)
     {